@@ -0,0 +1,310 @@
+#ifndef __COMPACTDICT_H__
+#define __COMPACTDICT_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hash.h"
+
+/*
+ * Insertion-ordered compact hash table, the layout of CPython's dict.
+ *
+ * Entries (key, object) are appended to a dense array in insertion order.
+ * The hash index is a separate open addressing array whose slots only
+ * hold the position of an entry in the dense array, so they are 1, 2 or
+ * 4 bytes wide depending on how many entries the table can hold. A full
+ * scan is a linear walk over the dense array, and besides the entries
+ * themselves the table costs a few bytes of index per entry, where an
+ * hlist table costs a node and a share of a bucket head.
+ *
+ * The index is 2/3 full at most and probed linearly from the top bits of
+ * hash_64(). Deleting an entry leaves a hole in the dense array and a
+ * dummy in the index; both are compacted away when the dense array fills
+ * up and the table is rebuilt, which also grows or shrinks it.
+ *
+ * Keys are 64-bit integers; objects must not be NULL, a NULL object marks
+ * a deleted entry. The table doesn't own the objects it points to.
+ */
+
+#define CDICT_MIN_BITS		3
+#define CDICT_MAX_BITS		31
+#define CDICT_EMPTY		(-1)
+#define CDICT_DUMMY		(-2)
+
+struct cdict_entry
+{
+	uint64_t key;
+	void *obj;
+};
+
+struct cdict
+{
+	void *index;			/* int8/16/32_t slots, see width */
+	struct cdict_entry *entries;
+	unsigned int bits;		/* log2 of index slots */
+	unsigned int width;		/* bytes per index slot */
+	unsigned long nentries;		/* used entries, holes included */
+	unsigned long size;		/* live entries */
+};
+
+static inline unsigned long cdict_count(const struct cdict *d)
+{
+	return d->size;
+}
+
+static inline bool cdict_empty(const struct cdict *d)
+{
+	return d->size == 0;
+}
+
+/* entries the dense array holds before the table is rebuilt */
+static inline unsigned long __cdict_usable(unsigned int bits)
+{
+	return (2UL << bits) / 3;
+}
+
+static inline unsigned int __cdict_width(unsigned int bits)
+{
+	if (bits <= 7)
+		return 1;
+	if (bits <= 15)
+		return 2;
+	return 4;
+}
+
+static inline long __cdict_get(const struct cdict *d, unsigned long i)
+{
+	switch (d->width) {
+	case 1:
+		return ((const int8_t *)d->index)[i];
+	case 2:
+		return ((const int16_t *)d->index)[i];
+	default:
+		return ((const int32_t *)d->index)[i];
+	}
+}
+
+static inline void __cdict_set(struct cdict *d, unsigned long i, long ix)
+{
+	switch (d->width) {
+	case 1:
+		((int8_t *)d->index)[i] = (int8_t)ix;
+		break;
+	case 2:
+		((int16_t *)d->index)[i] = (int16_t)ix;
+		break;
+	default:
+		((int32_t *)d->index)[i] = (int32_t)ix;
+	}
+}
+
+static inline int __cdict_alloc(struct cdict *d, unsigned int bits)
+{
+	unsigned int width = __cdict_width(bits);
+
+	d->index = malloc(width << bits);
+	d->entries = (struct cdict_entry *)malloc(__cdict_usable(bits) *
+						   sizeof(struct cdict_entry));
+	if (!d->index || !d->entries) {
+		free(d->index);
+		free(d->entries);
+		return -ENOMEM;
+	}
+
+	/* every width stores CDICT_EMPTY as all ones */
+	memset(d->index, 0xff, width << bits);
+	d->bits = bits;
+	d->width = width;
+	d->nentries = 0;
+	d->size = 0;
+
+	return 0;
+}
+
+/**
+ * cdict_init - initialize a compact hashtable
+ * @d: the table to initialize
+ * @bits: log2 of the initial number of index slots
+ *
+ * Returns 0 on success and -ENOMEM on allocation failure.
+ */
+static inline int cdict_init(struct cdict *d, unsigned int bits)
+{
+	if (bits < CDICT_MIN_BITS)
+		bits = CDICT_MIN_BITS;
+	if (bits > CDICT_MAX_BITS)
+		bits = CDICT_MAX_BITS;
+
+	return __cdict_alloc(d, bits);
+}
+
+/**
+ * cdict_destroy - release the arrays of a compact hashtable
+ * @d: the table to destroy
+ */
+static inline void cdict_destroy(struct cdict *d)
+{
+	free(d->index);
+	free(d->entries);
+	d->index = NULL;
+	d->entries = NULL;
+	d->nentries = d->size = 0;
+}
+
+/*
+ * Index slot of @key, or the first slot its insert could use (EMPTY or
+ * DUMMY) with *@found false.
+ */
+static inline unsigned long __cdict_probe(const struct cdict *d, uint64_t key,
+					  bool *found)
+{
+	unsigned long mask = (1UL << d->bits) - 1;
+	unsigned long i = hash_64(key, d->bits);
+	unsigned long free_slot = mask + 1;
+	long ix;
+
+	for (;; i = (i + 1) & mask) {
+		ix = __cdict_get(d, i);
+		if (ix == CDICT_EMPTY)
+			break;
+		if (ix == CDICT_DUMMY) {
+			if (free_slot > mask)
+				free_slot = i;
+		} else if (d->entries[ix].key == key) {
+			*found = true;
+			return i;
+		}
+	}
+
+	*found = false;
+	return free_slot > mask ? i : free_slot;
+}
+
+/* append an entry for a key known not to be present */
+static inline void __cdict_append(struct cdict *d, unsigned long slot,
+				  uint64_t key, void *obj)
+{
+	d->entries[d->nentries].key = key;
+	d->entries[d->nentries].obj = obj;
+	__cdict_set(d, slot, d->nentries);
+	d->nentries++;
+	d->size++;
+}
+
+/*
+ * Rebuild with 2^@bits index slots, copying live entries in order: holes
+ * and dummies are dropped.
+ */
+static inline int __cdict_resize(struct cdict *d, unsigned int bits)
+{
+	struct cdict old = *d;
+	unsigned long i, slot;
+	bool found;
+
+	if (__cdict_alloc(d, bits)) {
+		*d = old;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < old.nentries; i++) {
+		if (!old.entries[i].obj)
+			continue;
+		slot = __cdict_probe(d, old.entries[i].key, &found);
+		__cdict_append(d, slot, old.entries[i].key, old.entries[i].obj);
+	}
+
+	cdict_destroy(&old);
+	return 0;
+}
+
+/**
+ * cdict_lookup - find the object stored under @key
+ * @d: the table to search
+ * @key: the key to look up
+ *
+ * Returns the object, or NULL if @key isn't in the table.
+ */
+static inline void *cdict_lookup(const struct cdict *d, uint64_t key)
+{
+	bool found;
+	unsigned long slot = __cdict_probe(d, key, &found);
+
+	return found ? d->entries[__cdict_get(d, slot)].obj : NULL;
+}
+
+/**
+ * cdict_add - append an object to a compact hashtable
+ * @d: the table to add to
+ * @key: the key of the object
+ * @obj: the object, must not be NULL
+ *
+ * Returns 0 on success, -EEXIST if @key is already present and -ENOMEM
+ * if the table had to be rebuilt and couldn't.
+ */
+static inline int cdict_add(struct cdict *d, uint64_t key, void *obj)
+{
+	unsigned int bits = CDICT_MIN_BITS;
+	unsigned long slot;
+	bool found;
+
+	slot = __cdict_probe(d, key, &found);
+	if (found)
+		return -EEXIST;
+
+	if (d->nentries == __cdict_usable(d->bits)) {
+		/* room for twice the live entries, which may mean shrinking */
+		while (__cdict_usable(bits) < (d->size + 1) * 2)
+			bits++;
+		if (bits > CDICT_MAX_BITS || __cdict_resize(d, bits))
+			return -ENOMEM;
+		slot = __cdict_probe(d, key, &found);
+	}
+
+	__cdict_append(d, slot, key, obj);
+	return 0;
+}
+
+/**
+ * cdict_del - remove the object stored under @key
+ * @d: the table to remove from
+ * @key: the key to remove
+ *
+ * Returns the removed object, or NULL if @key wasn't in the table. The
+ * order of the remaining entries is kept.
+ */
+static inline void *cdict_del(struct cdict *d, uint64_t key)
+{
+	unsigned long slot;
+	bool found;
+	long ix;
+	void *obj;
+
+	slot = __cdict_probe(d, key, &found);
+	if (!found)
+		return NULL;
+
+	ix = __cdict_get(d, slot);
+	obj = d->entries[ix].obj;
+	d->entries[ix].obj = NULL;
+	__cdict_set(d, slot, CDICT_DUMMY);
+	d->size--;
+
+	return obj;
+}
+
+/**
+ * cdict_for_each - iterate over a compact hashtable in insertion order
+ * @d: the &struct cdict to iterate
+ * @i: unsigned long to use as entry loop cursor
+ * @entry: the struct cdict_entry * to use as a loop cursor for each entry
+ *
+ * The table must not be modified during the walk.
+ */
+#define cdict_for_each(d, i, entry)					\
+	for ((i) = 0; (i) < (d)->nentries; (i)++)			\
+		if (((entry) = &(d)->entries[i])->obj)
+
+#endif /* __COMPACTDICT_H__ */
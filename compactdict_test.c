@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hashtable.h"
+#include "compactdict.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+#define TABLE_BITS 20
+
+struct item
+{
+    uint64_t key;
+    struct hlist_node node;
+};
+
+DEFINE_HASHTABLE(table, TABLE_BITS);
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+}
+
+void TEST_CDICT()
+{
+    static struct item items[50000];
+    struct cdict_entry *e;
+    struct cdict d;
+    unsigned long i, k = 0, expect;
+    bool ok = true;
+
+    if (cdict_init(&d, 0)) {
+        printf("%-28s" KRED "\tFAILED\n" RESET, "TEST_CDICT");
+        return;
+    }
+
+    /* grows through 1, 2 and 4 byte index slots */
+    for (i = 0; i < 50000; i++) {
+        items[i].key = i * 0x9e3779b97f4a7c15ULL;
+        if (cdict_add(&d, items[i].key, &items[i]))
+            ok = false;
+    }
+    if (d.width != 4 || cdict_count(&d) != 50000)
+        ok = false;
+    if (cdict_add(&d, items[9].key, &items[9]) != -EEXIST)
+        ok = false;
+
+    for (i = 0; i < 50000; i += 3)
+        if (cdict_del(&d, items[i].key) != &items[i])
+            ok = false;
+    for (i = 0; i < 50000; i++)
+        if (cdict_lookup(&d, items[i].key) != (i % 3 ? &items[i] : NULL))
+            ok = false;
+
+    /*
+     * re-added entries go to the end and rebuilds keep the order: the
+     * survivors come first, then the multiples of 3
+     */
+    for (i = 0; i < 50000; i += 3)
+        cdict_add(&d, items[i].key, &items[i]);
+    cdict_for_each(&d, i, e) {
+        expect = k < 33333 ? k + k / 2 + 1 : (k - 33333) * 3;
+        if (e->obj != &items[expect])
+            ok = false;
+        k++;
+    }
+    if (cdict_count(&d) != 50000)
+        ok = false;
+    cdict_destroy(&d);
+
+    printf("%-28s", "TEST_CDICT");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/*
+ * Full scans of @n objects, and the table's own memory per entry on top
+ * of the key and object it stores: node and bucket heads for hlist,
+ * index slots and unused entries for cdict.
+ */
+void compare_scan(int n, int rounds)
+{
+    struct item *items = (struct item *)malloc(sizeof(struct item) * n);
+    struct cdict_entry *e;
+    struct item *obj;
+    struct cdict d;
+    unsigned long i, sum = 0, csum = 0;
+    unsigned int bkt;
+    double th, tc;
+    int r;
+
+    if (cdict_init(&d, 0)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    hash_init(table);
+    for (i = 0; i < (unsigned long)n; i++) {
+        items[i].key = rand64();
+        hash_add(table, &items[i].node, items[i].key);
+        cdict_add(&d, items[i].key, &items[i]);
+    }
+
+    th = now();
+    for (r = 0; r < rounds; r++)
+        hash_for_each(table, bkt, obj, node)
+            sum += obj->key;
+    th = now() - th;
+
+    tc = now();
+    for (r = 0; r < rounds; r++)
+        cdict_for_each(&d, i, e)
+            csum += e->key;
+    tc = now() - tc;
+
+    printf("%-10s%-16s%-16s%-16s%-16s\n", "Objects", "hlist scan(ms)",
+           "cdict scan(ms)", "hlist B/entry", "cdict B/entry");
+    printf("%-10d%-16.2f%-16.2f%-16.1f%-16.1f\n", n,
+           th * 1e3 / rounds, tc * 1e3 / rounds,
+           (double)(sizeof(struct hlist_node) * n +
+                    sizeof(struct hlist_head) * HASH_SIZE(table)) / n,
+           (double)((d.width << d.bits) + sizeof(struct cdict_entry) *
+                    (__cdict_usable(d.bits) - d.size)) / n);
+    if (sum != csum)
+        printf(KRED "scans disagree\n" RESET);
+
+    cdict_destroy(&d);
+    free(items);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <nobjects> <rounds>\n", argv[0]);
+        exit(1);
+    }
+
+    TEST_CDICT();
+    compare_scan(atoi(argv[1]), atoi(argv[2]));
+
+    return 0;
+}
@@ -0,0 +1,391 @@
+#ifndef __CUCKOO_H__
+#define __CUCKOO_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hash.h"
+
+/*
+ * Bucketized cuckoo hash table with bounded lookups.
+ *
+ * Every key has exactly two candidate buckets, and a bucket is 4 slots
+ * (keys and object pointers) in one 64-byte cache line, so a lookup reads
+ * at most two lines no matter how unlucky the keys are; a chained table
+ * instead walks however long the bucket's chain happens to be. The two
+ * bucket indexes come from hash_64(): the first from the key, the second
+ * from the first hash, forced to differ from the first.
+ *
+ * When both buckets are full, an insert searches breadth-first for the
+ * shortest chain of displacements that ends in a free slot, then moves
+ * entries back along it, so no entry is ever out of the table. If none is
+ * found within CUCKOO_BFS_NODES buckets the entry goes to a small stash,
+ * which lookups only read while it is non-empty; the table grows once the
+ * stash is full.
+ *
+ * Keys are 64-bit integers; the table doesn't own the objects it points
+ * to and NULL objects mark empty slots.
+ */
+
+#define CUCKOO_SLOTS		4
+#define CUCKOO_MIN_BITS		2
+#define CUCKOO_MAX_BITS		40
+#define CUCKOO_STASH		4
+#define CUCKOO_BFS_NODES	256
+#define CUCKOO_MAX_LOAD_NUM	95	/* grow past 95% full */
+#define CUCKOO_MAX_LOAD_DEN	100
+
+struct cuckoo_bucket
+{
+	uint64_t keys[CUCKOO_SLOTS];
+	void *objs[CUCKOO_SLOTS];
+} __attribute__((aligned(64)));
+
+struct cuckoo_table
+{
+	struct cuckoo_bucket *buckets;
+	unsigned int bits;		/* log2 of the number of buckets */
+	unsigned int stash_n;
+	unsigned long size;		/* entries, stash included */
+	uint64_t stash_keys[CUCKOO_STASH];
+	void *stash_objs[CUCKOO_STASH];
+};
+
+static inline unsigned long cuckoo_nr_buckets(const struct cuckoo_table *t)
+{
+	return 1UL << t->bits;
+}
+
+static inline unsigned long cuckoo_capacity(const struct cuckoo_table *t)
+{
+	return cuckoo_nr_buckets(t) * CUCKOO_SLOTS;
+}
+
+static inline unsigned long cuckoo_count(const struct cuckoo_table *t)
+{
+	return t->size;
+}
+
+static inline unsigned long __cuckoo_b1(uint64_t key, unsigned int bits)
+{
+	return hash_64(key, bits);
+}
+
+static inline unsigned long __cuckoo_b2(uint64_t key, unsigned int bits)
+{
+	unsigned long b1 = __cuckoo_b1(key, bits);
+	unsigned long b2 = hash_64(hash_64(key, 64), bits);
+
+	return b2 == b1 ? b1 ^ 1 : b2;
+}
+
+/* the candidate bucket of @key that isn't @bkt */
+static inline unsigned long __cuckoo_alt(uint64_t key, unsigned long bkt,
+					 unsigned int bits)
+{
+	unsigned long b1 = __cuckoo_b1(key, bits);
+
+	return bkt == b1 ? __cuckoo_b2(key, bits) : b1;
+}
+
+static inline int __cuckoo_alloc(struct cuckoo_table *t, unsigned int bits)
+{
+	size_t sz = sizeof(struct cuckoo_bucket) << bits;
+
+	t->buckets = (struct cuckoo_bucket *)aligned_alloc(64, sz);
+	if (!t->buckets)
+		return -ENOMEM;
+
+	memset(t->buckets, 0, sz);
+	t->bits = bits;
+	t->stash_n = 0;
+	t->size = 0;
+
+	return 0;
+}
+
+/**
+ * cuckoo_init - initialize a cuckoo hashtable
+ * @t: the table to initialize
+ * @bits: log2 of the initial number of 4-slot buckets
+ *
+ * Returns 0 on success and -ENOMEM on allocation failure.
+ */
+static inline int cuckoo_init(struct cuckoo_table *t, unsigned int bits)
+{
+	if (bits < CUCKOO_MIN_BITS)
+		bits = CUCKOO_MIN_BITS;
+	if (bits > CUCKOO_MAX_BITS)
+		bits = CUCKOO_MAX_BITS;
+
+	return __cuckoo_alloc(t, bits);
+}
+
+/**
+ * cuckoo_destroy - release the bucket array of a cuckoo hashtable
+ * @t: the table to destroy
+ */
+static inline void cuckoo_destroy(struct cuckoo_table *t)
+{
+	free(t->buckets);
+	t->buckets = NULL;
+	t->size = t->stash_n = 0;
+}
+
+static inline int __cuckoo_slot_of(const struct cuckoo_bucket *b, uint64_t key)
+{
+	int i;
+
+	for (i = 0; i < CUCKOO_SLOTS; i++)
+		if (b->keys[i] == key && b->objs[i])
+			return i;
+
+	return -1;
+}
+
+static inline int __cuckoo_free_slot(const struct cuckoo_bucket *b)
+{
+	int i;
+
+	for (i = 0; i < CUCKOO_SLOTS; i++)
+		if (!b->objs[i])
+			return i;
+
+	return -1;
+}
+
+/**
+ * cuckoo_lookup - find the object stored under @key
+ * @t: the table to search
+ * @key: the key to look up
+ *
+ * Returns the object, or NULL if @key isn't in the table.
+ */
+static inline void *cuckoo_lookup(const struct cuckoo_table *t, uint64_t key)
+{
+	const struct cuckoo_bucket *b1 = &t->buckets[__cuckoo_b1(key, t->bits)];
+	const struct cuckoo_bucket *b2 = &t->buckets[__cuckoo_b2(key, t->bits)];
+	unsigned int i;
+	int s;
+
+	__builtin_prefetch(b2);
+	if ((s = __cuckoo_slot_of(b1, key)) >= 0)
+		return b1->objs[s];
+	if ((s = __cuckoo_slot_of(b2, key)) >= 0)
+		return b2->objs[s];
+
+	for (i = 0; i < t->stash_n; i++)
+		if (t->stash_keys[i] == key)
+			return t->stash_objs[i];
+
+	return NULL;
+}
+
+struct __cuckoo_bfs
+{
+	unsigned long bkt;
+	int parent;		/* queue index of the bucket we came from */
+	int slot;		/* slot of parent whose entry moves here */
+};
+
+/*
+ * Free a slot in one of @key's buckets by moving entries along the
+ * shortest displacement path. Returns the bucket with a free slot, or -1
+ * if none was found within CUCKOO_BFS_NODES buckets.
+ */
+static inline long __cuckoo_make_room(struct cuckoo_table *t, uint64_t key)
+{
+	struct __cuckoo_bfs q[CUCKOO_BFS_NODES];
+	struct cuckoo_bucket *from, *to;
+	int head = 0, tail = 0, i, s;
+
+	q[tail++] = (struct __cuckoo_bfs){ __cuckoo_b1(key, t->bits), -1, -1 };
+	q[tail++] = (struct __cuckoo_bfs){ __cuckoo_b2(key, t->bits), -1, -1 };
+
+	for (; head < tail; head++) {
+		s = __cuckoo_free_slot(&t->buckets[q[head].bkt]);
+		if (s >= 0)
+			goto found;
+
+		for (i = 0; i < CUCKOO_SLOTS && tail < CUCKOO_BFS_NODES; i++) {
+			uint64_t k = t->buckets[q[head].bkt].keys[i];
+
+			q[tail++] = (struct __cuckoo_bfs){
+				__cuckoo_alt(k, q[head].bkt, t->bits), head, i };
+		}
+	}
+
+	return -1;
+
+found:
+	/* walk back to the root, moving each entry into the hole ahead of it */
+	for (i = head; q[i].parent >= 0; i = q[i].parent) {
+		from = &t->buckets[q[q[i].parent].bkt];
+		to = &t->buckets[q[i].bkt];
+		to->keys[s] = from->keys[q[i].slot];
+		to->objs[s] = from->objs[q[i].slot];
+		s = q[i].slot;
+		from->objs[s] = NULL;
+	}
+
+	return q[i].bkt;
+}
+
+static inline int __cuckoo_insert(struct cuckoo_table *t, uint64_t key,
+				  void *obj)
+{
+	struct cuckoo_bucket *b;
+	long bkt;
+	int s;
+
+	bkt = __cuckoo_make_room(t, key);
+	if (bkt < 0) {
+		if (t->stash_n == CUCKOO_STASH)
+			return -ENOSPC;
+		t->stash_keys[t->stash_n] = key;
+		t->stash_objs[t->stash_n++] = obj;
+		t->size++;
+		return 0;
+	}
+
+	b = &t->buckets[bkt];
+	s = __cuckoo_free_slot(b);
+	b->keys[s] = key;
+	b->objs[s] = obj;
+	t->size++;
+
+	return 0;
+}
+
+/* rebuild into 2^@bits buckets, growing further if the entries don't fit */
+static inline int __cuckoo_rehash(struct cuckoo_table *t, unsigned int bits)
+{
+	struct cuckoo_table old = *t;
+	unsigned long b;
+	unsigned int i;
+
+retry:
+	if (bits > CUCKOO_MAX_BITS || __cuckoo_alloc(t, bits)) {
+		*t = old;
+		return -ENOMEM;
+	}
+
+	for (b = 0; b < cuckoo_nr_buckets(&old); b++)
+		for (i = 0; i < CUCKOO_SLOTS; i++)
+			if (old.buckets[b].objs[i] &&
+			    __cuckoo_insert(t, old.buckets[b].keys[i],
+					    old.buckets[b].objs[i]))
+				goto again;
+	for (i = 0; i < old.stash_n; i++)
+		if (__cuckoo_insert(t, old.stash_keys[i], old.stash_objs[i]))
+			goto again;
+
+	free(old.buckets);
+	return 0;
+
+again:
+	free(t->buckets);
+	bits++;
+	goto retry;
+}
+
+/**
+ * cuckoo_add - add an object to a cuckoo hashtable
+ * @t: the table to add to
+ * @key: the key of the object
+ * @obj: the object, must not be NULL
+ *
+ * Returns 0 on success, -EEXIST if @key is already present and -ENOMEM
+ * if the table had to grow and couldn't.
+ */
+static inline int cuckoo_add(struct cuckoo_table *t, uint64_t key, void *obj)
+{
+	if (cuckoo_lookup(t, key))
+		return -EEXIST;
+
+	if ((t->size + 1) * CUCKOO_MAX_LOAD_DEN >
+	    cuckoo_capacity(t) * CUCKOO_MAX_LOAD_NUM &&
+	    __cuckoo_rehash(t, t->bits + 1))
+		return -ENOMEM;
+
+	while (__cuckoo_insert(t, key, obj))
+		if (__cuckoo_rehash(t, t->bits + 1))
+			return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * cuckoo_del - remove the object stored under @key
+ * @t: the table to remove from
+ * @key: the key to remove
+ *
+ * Returns the removed object, or NULL if @key wasn't in the table.
+ */
+static inline void *cuckoo_del(struct cuckoo_table *t, uint64_t key)
+{
+	struct cuckoo_bucket *b[2] = {
+		&t->buckets[__cuckoo_b1(key, t->bits)],
+		&t->buckets[__cuckoo_b2(key, t->bits)],
+	};
+	unsigned int i;
+	void *obj;
+	int s;
+
+	for (i = 0; i < 2; i++) {
+		if ((s = __cuckoo_slot_of(b[i], key)) >= 0) {
+			obj = b[i]->objs[s];
+			b[i]->objs[s] = NULL;
+			t->size--;
+			return obj;
+		}
+	}
+
+	for (i = 0; i < t->stash_n; i++) {
+		if (t->stash_keys[i] == key) {
+			obj = t->stash_objs[i];
+			t->stash_n--;
+			t->stash_keys[i] = t->stash_keys[t->stash_n];
+			t->stash_objs[i] = t->stash_objs[t->stash_n];
+			t->size--;
+			return obj;
+		}
+	}
+
+	return NULL;
+}
+
+/* slot @i of the bucket array, then of the stash; false if it is empty */
+static inline bool __cuckoo_entry(const struct cuckoo_table *t,
+				  unsigned long i, uint64_t *key, void **obj)
+{
+	unsigned long cap = cuckoo_capacity(t);
+
+	if (i < cap) {
+		*key = t->buckets[i / CUCKOO_SLOTS].keys[i % CUCKOO_SLOTS];
+		*obj = t->buckets[i / CUCKOO_SLOTS].objs[i % CUCKOO_SLOTS];
+	} else {
+		*key = t->stash_keys[i - cap];
+		*obj = t->stash_objs[i - cap];
+	}
+
+	return *obj != NULL;
+}
+
+/**
+ * cuckoo_for_each - iterate over a cuckoo hashtable
+ * @t: the &struct cuckoo_table to iterate
+ * @i: unsigned long to use as slot loop cursor
+ * @key: uint64_t set to the key of each entry
+ * @obj: void * set to each object
+ *
+ * The table must not be modified during the walk.
+ */
+#define cuckoo_for_each(t, i, key, obj)					\
+	for ((i) = 0; (i) < cuckoo_capacity(t) + (t)->stash_n; (i)++)	\
+		if (!__cuckoo_entry(t, i, &(key), &(obj))) {} else
+
+#endif /* __CUCKOO_H__ */
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hashtable.h"
+#include "cuckoo.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+#define TABLE_BITS 20
+
+struct item
+{
+    uint64_t key;
+    struct hlist_node node;
+};
+
+DEFINE_HASHTABLE(table, TABLE_BITS);
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static struct item *lookup_chained(uint64_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible(table, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+void TEST_CUCKOO()
+{
+    struct cuckoo_table t;
+    static struct item items[20000];
+    unsigned long i, cnt = 0;
+    uint64_t key;
+    void *obj;
+    bool ok = true;
+
+    /* start tiny so the inserts go through displacement, stash and growth */
+    if (cuckoo_init(&t, 0)) {
+        printf("%-28s" KRED "\tFAILED\n" RESET, "TEST_CUCKOO");
+        return;
+    }
+    for (i = 0; i < 20000; i++) {
+        items[i].key = i * 0x9e3779b97f4a7c15ULL;
+        if (cuckoo_add(&t, items[i].key, &items[i]))
+            ok = false;
+    }
+    if (cuckoo_add(&t, items[7].key, &items[7]) != -EEXIST)
+        ok = false;
+    if (cuckoo_count(&t) != 20000)
+        ok = false;
+
+    for (i = 0; i < 20000; i++)
+        if (cuckoo_lookup(&t, items[i].key) != &items[i])
+            ok = false;
+    for (i = 0; i < 20000; i += 2)
+        if (cuckoo_del(&t, items[i].key) != &items[i])
+            ok = false;
+    for (i = 0; i < 20000; i++)
+        if (cuckoo_lookup(&t, items[i].key) != ((i & 1) ? &items[i] : NULL))
+            ok = false;
+
+    cuckoo_for_each(&t, i, key, obj) {
+        if (((struct item *)obj)->key != key)
+            ok = false;
+        cnt++;
+    }
+    if (cnt != 10000 || cuckoo_count(&t) != 10000)
+        ok = false;
+
+    /* an else after the loop belongs to the caller's if */
+    if (cnt == 10000)
+        cuckoo_for_each(&t, i, key, obj)
+            cnt--;
+    else
+        ok = false;
+    if (cnt)
+        ok = false;
+    cuckoo_destroy(&t);
+
+    printf("%-28s", "TEST_CUCKOO");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/*
+ * Time every lookup on its own and report the tail. Both tables index the
+ * same objects, the chained one at a load factor of @n / 2^TABLE_BITS.
+ */
+void compare_latency(unsigned long n, unsigned long nlookups)
+{
+    struct item *items = (struct item *)malloc(sizeof(struct item) * n);
+    double *lat = (double *)malloc(sizeof(double) * nlookups);
+    unsigned long *order = (unsigned long *)malloc(sizeof(unsigned long) * nlookups);
+    struct cuckoo_table t;
+    unsigned long i, misses = 0;
+    double t0, base = 1e9;
+    int pass;
+
+    if (cuckoo_init(&t, TABLE_BITS - 2)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    hash_init(table);
+    for (i = 0; i < n; i++) {
+        items[i].key = rand64();
+        hash_add(table, &items[i].node, items[i].key);
+        if (cuckoo_add(&t, items[i].key, &items[i]) == -ENOMEM)
+            misses++;
+    }
+    for (i = 0; i < nlookups; i++)
+        order[i] = (unsigned long)rand() % n;
+
+    /* cost of the timer itself, subtracted from every sample */
+    for (i = 0; i < 1000; i++) {
+        t0 = now();
+        t0 = now() - t0;
+        if (t0 < base)
+            base = t0;
+    }
+
+    printf("%-12s%-12s%-12s%-12s%-12s\n", "Table", "p50(ns)", "p99(ns)",
+           "p999(ns)", "max(ns)");
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < nlookups; i++) {
+            uint64_t key = items[order[i]].key;
+
+            t0 = now();
+            if (pass == 0 ? lookup_chained(key) == NULL
+                          : cuckoo_lookup(&t, key) == NULL)
+                misses++;
+            lat[i] = (now() - t0 - base) * 1e9;
+        }
+        qsort(lat, nlookups, sizeof(double), cmp_double);
+        printf("%-12s%-12.0f%-12.0f%-12.0f%-12.0f\n",
+               pass == 0 ? "chained" : "cuckoo",
+               lat[nlookups / 2], lat[nlookups * 99 / 100],
+               lat[nlookups * 999 / 1000], lat[nlookups - 1]);
+    }
+    printf("(%lu entries, chained load %.2f, cuckoo load %.2f, stash %u)\n",
+           n, (double)n / HASH_SIZE(table),
+           (double)cuckoo_count(&t) / cuckoo_capacity(&t), t.stash_n);
+
+    if (misses)
+        printf(KRED "%lu lookups failed\n" RESET, misses);
+
+    cuckoo_destroy(&t);
+    free(order);
+    free(lat);
+    free(items);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <nobjects> <nlookups>\n", argv[0]);
+        exit(1);
+    }
+
+    TEST_CUCKOO();
+    compare_latency(atol(argv[1]), atol(argv[2]));
+
+    return 0;
+}
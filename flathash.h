@@ -0,0 +1,341 @@
+#ifndef __FLATHASH_H__
+#define __FLATHASH_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hash.h"
+
+/* build with -DFHASH_NO_SIMD to use the scalar group match */
+#if defined(__SSE2__) && !defined(FHASH_NO_SIMD)
+#define FHASH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/*
+ * Open addressing hash table with SIMD-probed control bytes.
+ *
+ * Where the hlist tables chase one node pointer per probe, this engine
+ * keeps keys and object pointers in a flat slot array next to a byte
+ * array of control bytes, one per slot: EMPTY, DELETED, or 7 bits of the
+ * key's hash (H2) when the slot is full. Slots are grouped by 16; a probe
+ * compares H2 against all 16 control bytes of a group in one SSE2 compare
+ * and only touches the slots whose byte matched, so a lookup usually
+ * costs the control line plus one slot line. Groups are visited in
+ * triangular order, which covers every group of a power-of-two table.
+ *
+ * Keys are 64-bit integers hashed with hash_64(); store a digest (or a
+ * pointer) for anything larger. The table doesn't own the objects it
+ * points to. The API follows hashtable.h where it can: fhash_add(),
+ * fhash_del(), fhash_lookup() and fhash_for_each().
+ */
+
+#define FHASH_GROUP_WIDTH	16
+#define FHASH_MIN_BITS		4	/* one group */
+#define FHASH_MAX_BITS		48	/* keeps 7 hash bits below the index */
+#define FHASH_MAX_LOAD_NUM	7	/* grow past 7/8 full */
+#define FHASH_MAX_LOAD_DEN	8
+
+#define FHASH_CTRL_EMPTY	((int8_t)-128)	/* 0b10000000 */
+#define FHASH_CTRL_DELETED	((int8_t)-2)	/* 0b11111110 */
+
+struct fhash_slot
+{
+	uint64_t key;
+	void *obj;
+};
+
+struct fhashtable
+{
+	int8_t *ctrl;			/* capacity control bytes */
+	struct fhash_slot *slots;
+	unsigned int bits;		/* log2 of capacity */
+	unsigned long size;		/* full slots */
+	unsigned long deleted;		/* tombstones */
+};
+
+static inline uint64_t __fhash_hash(uint64_t key)
+{
+	return hash_64(key, 64);
+}
+
+/* group index from the top bits, H2 from the 7 bits right below them */
+static inline unsigned long __fhash_h1(uint64_t hash, unsigned int bits)
+{
+	return hash >> (64 - bits);
+}
+
+static inline int8_t __fhash_h2(uint64_t hash, unsigned int bits)
+{
+	return (int8_t)((hash >> (64 - bits - 7)) & 0x7f);
+}
+
+/*
+ * Group match: bit i of the result is set if control byte i of the group
+ * equals @c.
+ */
+#ifdef FHASH_SSE2
+static inline unsigned int __fhash_match(const int8_t *group, int8_t c)
+{
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+
+	return (unsigned int)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(c)));
+}
+#else
+static inline unsigned int __fhash_match(const int8_t *group, int8_t c)
+{
+	unsigned int i, mask = 0;
+
+	for (i = 0; i < FHASH_GROUP_WIDTH; i++)
+		if (group[i] == c)
+			mask |= 1U << i;
+
+	return mask;
+}
+#endif
+
+static inline unsigned long fhash_capacity(const struct fhashtable *t)
+{
+	return 1UL << t->bits;
+}
+
+static inline unsigned long fhash_count(const struct fhashtable *t)
+{
+	return t->size;
+}
+
+static inline bool fhash_empty(const struct fhashtable *t)
+{
+	return t->size == 0;
+}
+
+static inline int __fhash_alloc(struct fhashtable *t, unsigned int bits)
+{
+	unsigned long cap = 1UL << bits;
+
+	t->ctrl = (int8_t *)malloc(cap);
+	t->slots = (struct fhash_slot *)malloc(cap * sizeof(struct fhash_slot));
+	if (!t->ctrl || !t->slots) {
+		free(t->ctrl);
+		free(t->slots);
+		return -ENOMEM;
+	}
+
+	memset(t->ctrl, FHASH_CTRL_EMPTY, cap);
+	t->bits = bits;
+	t->size = 0;
+	t->deleted = 0;
+
+	return 0;
+}
+
+/**
+ * fhash_init - initialize a flat hashtable
+ * @t: the table to initialize
+ * @bits: log2 of the initial number of slots
+ *
+ * Returns 0 on success and -ENOMEM on allocation failure.
+ */
+static inline int fhash_init(struct fhashtable *t, unsigned int bits)
+{
+	if (bits < FHASH_MIN_BITS)
+		bits = FHASH_MIN_BITS;
+	if (bits > FHASH_MAX_BITS)
+		bits = FHASH_MAX_BITS;
+
+	return __fhash_alloc(t, bits);
+}
+
+/**
+ * fhash_destroy - release the arrays of a flat hashtable
+ * @t: the table to destroy
+ */
+static inline void fhash_destroy(struct fhashtable *t)
+{
+	free(t->ctrl);
+	free(t->slots);
+	t->ctrl = NULL;
+	t->slots = NULL;
+	t->size = t->deleted = 0;
+}
+
+/* find the slot holding @key, or -1 */
+static inline long __fhash_find(const struct fhashtable *t, uint64_t key)
+{
+	uint64_t hash = __fhash_hash(key);
+	unsigned long gmask = (fhash_capacity(t) / FHASH_GROUP_WIDTH) - 1;
+	unsigned long g = __fhash_h1(hash, t->bits) / FHASH_GROUP_WIDTH;
+	int8_t h2 = __fhash_h2(hash, t->bits);
+	unsigned long step;
+	unsigned int mask, i;
+
+	for (step = 1; ; g = (g + step++) & gmask) {
+		const int8_t *group = &t->ctrl[g * FHASH_GROUP_WIDTH];
+
+		for (mask = __fhash_match(group, h2); mask; mask &= mask - 1) {
+			i = __builtin_ctz(mask);
+			if (t->slots[g * FHASH_GROUP_WIDTH + i].key == key)
+				return g * FHASH_GROUP_WIDTH + i;
+		}
+
+		/* an empty slot ends every probe sequence through this group */
+		if (__fhash_match(group, FHASH_CTRL_EMPTY))
+			return -1;
+
+		if (step > gmask)
+			return -1;
+	}
+}
+
+/* first empty or deleted slot on @key's probe sequence */
+static inline unsigned long __fhash_find_free(const struct fhashtable *t,
+					      uint64_t hash)
+{
+	unsigned long gmask = (fhash_capacity(t) / FHASH_GROUP_WIDTH) - 1;
+	unsigned long g = __fhash_h1(hash, t->bits) / FHASH_GROUP_WIDTH;
+	unsigned long step;
+	unsigned int mask;
+
+	for (step = 1; ; g = (g + step++) & gmask) {
+		const int8_t *group = &t->ctrl[g * FHASH_GROUP_WIDTH];
+
+		/* EMPTY and DELETED are the only control bytes with bit 7 set */
+		mask = __fhash_match(group, FHASH_CTRL_EMPTY) |
+		       __fhash_match(group, FHASH_CTRL_DELETED);
+		if (mask)
+			return g * FHASH_GROUP_WIDTH + __builtin_ctz(mask);
+	}
+}
+
+static inline void __fhash_insert_slot(struct fhashtable *t, uint64_t key,
+				       void *obj)
+{
+	uint64_t hash = __fhash_hash(key);
+	unsigned long i = __fhash_find_free(t, hash);
+
+	if (t->ctrl[i] == FHASH_CTRL_DELETED)
+		t->deleted--;
+	t->ctrl[i] = __fhash_h2(hash, t->bits);
+	t->slots[i].key = key;
+	t->slots[i].obj = obj;
+	t->size++;
+}
+
+/*
+ * Rebuild into a table of 2^@bits slots. Called with the same size when
+ * most of the load is tombstones, to reclaim them.
+ */
+static inline int __fhash_rehash(struct fhashtable *t, unsigned int bits)
+{
+	struct fhashtable old = *t;
+	unsigned long i;
+
+	if (__fhash_alloc(t, bits)) {
+		*t = old;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < fhash_capacity(&old); i++)
+		if (old.ctrl[i] >= 0)
+			__fhash_insert_slot(t, old.slots[i].key, old.slots[i].obj);
+
+	fhash_destroy(&old);
+	return 0;
+}
+
+/**
+ * fhash_lookup - find the object stored under @key
+ * @t: the table to search
+ * @key: the key to look up
+ *
+ * Returns the object, or NULL if @key isn't in the table.
+ */
+static inline void *fhash_lookup(const struct fhashtable *t, uint64_t key)
+{
+	long i = __fhash_find(t, key);
+
+	return i < 0 ? NULL : t->slots[i].obj;
+}
+
+/**
+ * fhash_add - add an object to a flat hashtable
+ * @t: the table to add to
+ * @key: the key of the object
+ * @obj: the object, must not be NULL
+ *
+ * Returns 0 on success, -EEXIST if @key is already present and -ENOMEM
+ * if the table had to grow and couldn't.
+ */
+static inline int fhash_add(struct fhashtable *t, uint64_t key, void *obj)
+{
+	unsigned long cap = fhash_capacity(t);
+
+	if (__fhash_find(t, key) >= 0)
+		return -EEXIST;
+
+	if ((t->size + t->deleted + 1) * FHASH_MAX_LOAD_DEN >
+	    cap * FHASH_MAX_LOAD_NUM) {
+		/* grow only if live entries need it, else just drop tombstones */
+		unsigned int bits = t->bits;
+
+		if ((t->size + 1) * FHASH_MAX_LOAD_DEN * 2 >
+		    cap * FHASH_MAX_LOAD_NUM)
+			bits++;
+		if (bits > FHASH_MAX_BITS || __fhash_rehash(t, bits))
+			return -ENOMEM;
+	}
+
+	__fhash_insert_slot(t, key, obj);
+	return 0;
+}
+
+/**
+ * fhash_del - remove the object stored under @key
+ * @t: the table to remove from
+ * @key: the key to remove
+ *
+ * Returns the removed object, or NULL if @key wasn't in the table.
+ */
+static inline void *fhash_del(struct fhashtable *t, uint64_t key)
+{
+	long i = __fhash_find(t, key);
+	const int8_t *group;
+
+	if (i < 0)
+		return NULL;
+
+	/*
+	 * A group that still has an empty slot has never been full since the
+	 * last rehash, so no probe sequence continues past it and the slot
+	 * can go straight back to EMPTY instead of becoming a tombstone.
+	 */
+	group = &t->ctrl[i & ~(long)(FHASH_GROUP_WIDTH - 1)];
+	if (__fhash_match(group, FHASH_CTRL_EMPTY)) {
+		t->ctrl[i] = FHASH_CTRL_EMPTY;
+	} else {
+		t->ctrl[i] = FHASH_CTRL_DELETED;
+		t->deleted++;
+	}
+	t->size--;
+
+	return t->slots[i].obj;
+}
+
+/**
+ * fhash_for_each - iterate over a flat hashtable
+ * @t: the &struct fhashtable to iterate
+ * @i: unsigned long to use as slot loop cursor
+ * @slot: the struct fhash_slot * to use as a loop cursor for each entry
+ *
+ * The table must not be modified during the walk.
+ */
+#define fhash_for_each(t, i, slot)					\
+	for ((i) = 0; (i) < fhash_capacity(t); (i)++)			\
+		if (!((t)->ctrl[i] >= 0 &&				\
+		      ((slot) = &(t)->slots[i], 1))) {} else
+
+#endif /* __FLATHASH_H__ */
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "flathash.h"
+#include "rhashtable.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+struct item
+{
+    uint64_t key;
+    struct hlist_node node;
+};
+
+static uint64_t item_hash(const struct hlist_node *node)
+{
+    return hlist_entry(node, struct item, node)->key;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+}
+
+/* random add/del/lookup against a presence array */
+void TEST_FHASH(int n)
+{
+    struct fhashtable t;
+    char *present = (char *)calloc(n, 1);
+    struct fhash_slot *slot;
+    unsigned long i, cnt = 0, live = 0;
+    bool ok = true;
+    int op, k, r;
+
+    fhash_init(&t, 4);
+
+    for (op = 0; op < 8 * n; op++) {
+        k = rand() % n;
+        switch (rand() % 3) {
+        case 0:
+            r = fhash_add(&t, k, present + k);
+            if (r != (present[k] ? -EEXIST : 0))
+                ok = false;
+            if (!present[k]) live++;
+            present[k] = 1;
+            break;
+        case 1:
+            if (fhash_del(&t, k) != (present[k] ? present + k : NULL))
+                ok = false;
+            if (present[k]) live--;
+            present[k] = 0;
+            break;
+        default:
+            if (fhash_lookup(&t, k) != (present[k] ? present + k : NULL))
+                ok = false;
+        }
+    }
+
+    fhash_for_each(&t, i, slot) {
+        if (!present[slot->key] || slot->obj != present + slot->key)
+            ok = false;
+        cnt++;
+    }
+    if (cnt != live || fhash_count(&t) != live)
+        ok = false;
+
+    /* an else after the loop belongs to the caller's if */
+    if (cnt == live)
+        fhash_for_each(&t, i, slot)
+            cnt--;
+    else
+        ok = false;
+    if (cnt)
+        ok = false;
+
+    printf("%-28s cap %lu, %lu live ", "TEST_FHASH", fhash_capacity(&t), live);
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+
+    fhash_destroy(&t);
+    free(present);
+}
+
+static struct item *rhash_find(struct rhashtable *ht, uint64_t key)
+{
+    struct item *obj;
+
+    rhash_for_each_possible(ht, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+/* same keys, same operation order, both engines */
+void compare_engines(int n)
+{
+    struct item *items = (struct item *)malloc(sizeof(struct item) * n);
+    uint64_t *miss = (uint64_t *)malloc(sizeof(uint64_t) * n);
+    struct fhashtable t;
+    struct rhashtable ht;
+    double t0, f[4], c[4];
+    unsigned long found = 0;
+    int i;
+
+    srand((unsigned)time(0));
+    for (i = 0; i < n; i++) {
+        items[i].key = rand64();
+        miss[i] = rand64();
+    }
+    fhash_init(&t, 4);
+    rhash_init(&ht, 4, item_hash);
+
+    t0 = now();
+    for (i = 0; i < n; i++)
+        fhash_add(&t, items[i].key, &items[i]);
+    f[0] = now() - t0;
+    t0 = now();
+    for (i = 0; i < n; i++)
+        found += fhash_lookup(&t, items[(i * 7919UL) % n].key) != NULL;
+    f[1] = now() - t0;
+    t0 = now();
+    for (i = 0; i < n; i++)
+        found += fhash_lookup(&t, miss[i]) != NULL;
+    f[2] = now() - t0;
+    t0 = now();
+    for (i = 0; i < n; i++)
+        fhash_del(&t, items[i].key);
+    f[3] = now() - t0;
+
+    t0 = now();
+    for (i = 0; i < n; i++)
+        rhash_add(&ht, &items[i].node);
+    c[0] = now() - t0;
+    t0 = now();
+    for (i = 0; i < n; i++)
+        found += rhash_find(&ht, items[(i * 7919UL) % n].key) != NULL;
+    c[1] = now() - t0;
+    t0 = now();
+    for (i = 0; i < n; i++)
+        found += rhash_find(&ht, miss[i]) != NULL;
+    c[2] = now() - t0;
+    t0 = now();
+    for (i = 0; i < n; i++)
+        rhash_del(&ht, &items[i].node);
+    c[3] = now() - t0;
+
+    printf("%-10s%-10s%-12s%-12s%-12s%-12s (ns/op)\n", "Size", "Engine",
+           "Insert", "Hit", "Miss", "Delete");
+    printf("%-10d%-10s%-12.1f%-12.1f%-12.1f%-12.1f\n", n,
+#ifdef FHASH_SSE2
+           "flat-sse2",
+#else
+           "flat",
+#endif
+           f[0] * 1e9 / n, f[1] * 1e9 / n, f[2] * 1e9 / n, f[3] * 1e9 / n);
+    printf("%-10d%-10s%-12.1f%-12.1f%-12.1f%-12.1f\n", n, "chained",
+           c[0] * 1e9 / n, c[1] * 1e9 / n, c[2] * 1e9 / n, c[3] * 1e9 / n);
+    if (found != 2UL * n)
+        printf(KRED "lookup mismatch: %lu\n" RESET, found);
+
+    fhash_destroy(&t);
+    rhash_destroy(&ht);
+    free(items);
+    free(miss);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <num>\n", argv[0]);
+        exit(1);
+    }
+
+    TEST_FHASH(atoi(argv[1]));
+    compare_engines(atoi(argv[1]));
+
+    return 0;
+}
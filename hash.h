@@ -2,6 +2,23 @@
 #define __HASH_H__
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#if defined(__linux__)
+#include <sys/random.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
+	defined(__NetBSD__)
+#include <stdlib.h>
+#define HASH_HAVE_ARC4RANDOM 1
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HASH_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
 
 /* Fast hashing routine for ints,  longs and pointers.
    (C) 2002 Nadia Yvette Chambers, IBM */
@@ -22,6 +39,18 @@
 /*  2^63 + 2^61 - 2^57 + 2^54 - 2^51 - 2^18 + 1 */
 #define GOLDEN_RATIO_PRIME_64 0x9e37fffffffc0001UL
 
+#ifndef BITS_PER_LONG
+#if ULONG_MAX == 0xffffffffUL
+#define BITS_PER_LONG 32
+#else
+#define BITS_PER_LONG 64
+#endif
+#endif
+
+#ifndef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#endif
+
 #if BITS_PER_LONG == 32
 #define GOLDEN_RATIO_PRIME GOLDEN_RATIO_PRIME_32
 #define hash_long(val, bits) hash_32(val, bits)
@@ -78,4 +107,416 @@ static inline uint32_t hash32_ptr(const void *ptr)
 #endif
 	return (uint32_t)val;
 }
+
+/*
+ * Batched hash_32()/hash_64() over arrays.
+ *
+ * The AVX2 kernels hash 8 (32-bit) or 4 (64-bit) keys per instruction
+ * sequence and are bit-identical to the scalar functions: hash_32() is the
+ * same 32-bit multiply, and hash_64() replays its shift/add chain on 64-bit
+ * lanes since AVX2 has no 64-bit multiply. The path is picked at run time
+ * with __builtin_cpu_supports(), so the header needs no -mavx2.
+ *
+ * @bits must be in [1, 32], the output is one uint32_t bucket per key.
+ */
+
+static inline void __hash_32_batch_scalar(const uint32_t *in, uint32_t *out,
+					  size_t n, unsigned int bits)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = hash_32(in[i], bits);
+}
+
+static inline void __hash_64_batch_scalar(const uint64_t *in, uint32_t *out,
+					  size_t n, unsigned int bits)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = (uint32_t)hash_64(in[i], bits);
+}
+
+#ifdef HASH_HAVE_AVX2
+__attribute__((target("avx2")))
+static inline void __hash_32_batch_avx2(const uint32_t *in, uint32_t *out,
+					size_t n, unsigned int bits)
+{
+	const __m256i prime = _mm256_set1_epi32((int)GOLDEN_RATIO_PRIME_32);
+	const __m128i shift = _mm_cvtsi32_si128(32 - bits);
+	size_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+
+		v = _mm256_srl_epi32(_mm256_mullo_epi32(v, prime), shift);
+		_mm256_storeu_si256((__m256i *)(out + i), v);
+	}
+
+	__hash_32_batch_scalar(in + i, out + i, n - i, bits);
+}
+
+__attribute__((target("avx2")))
+static inline void __hash_64_batch_avx2(const uint64_t *in, uint32_t *out,
+					size_t n, unsigned int bits)
+{
+	/* picks the low dword of each 64-bit lane into the low 128 bits */
+	const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	const __m128i shift = _mm_cvtsi32_si128(64 - bits);
+	size_t i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m256i hash = _mm256_loadu_si256((const __m256i *)(in + i));
+		__m256i v = hash;
+
+		/* same chain as hash_64() */
+		v = _mm256_slli_epi64(v, 18);
+		hash = _mm256_sub_epi64(hash, v);
+		v = _mm256_slli_epi64(v, 33);
+		hash = _mm256_sub_epi64(hash, v);
+		v = _mm256_slli_epi64(v, 3);
+		hash = _mm256_add_epi64(hash, v);
+		v = _mm256_slli_epi64(v, 3);
+		hash = _mm256_sub_epi64(hash, v);
+		v = _mm256_slli_epi64(v, 4);
+		hash = _mm256_add_epi64(hash, v);
+		v = _mm256_slli_epi64(v, 2);
+		hash = _mm256_add_epi64(hash, v);
+
+		hash = _mm256_srl_epi64(hash, shift);
+		hash = _mm256_permutevar8x32_epi32(hash, pack);
+		_mm_storeu_si128((__m128i *)(out + i),
+				 _mm256_castsi256_si128(hash));
+	}
+
+	__hash_64_batch_scalar(in + i, out + i, n - i, bits);
+}
+#endif
+
+static inline bool __hash_cpu_has_avx2(void)
+{
+#ifdef HASH_HAVE_AVX2
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+/**
+ * hash_32_batch - hash_32() every element of an array
+ * @in: keys to hash
+ * @out: bucket index of each key
+ * @n: number of keys
+ * @bits: log2 of the number of buckets, 1 to 32
+ */
+static inline void hash_32_batch(const uint32_t *in, uint32_t *out, size_t n,
+				 unsigned int bits)
+{
+#ifdef HASH_HAVE_AVX2
+	if (__hash_cpu_has_avx2()) {
+		__hash_32_batch_avx2(in, out, n, bits);
+		return;
+	}
+#endif
+	__hash_32_batch_scalar(in, out, n, bits);
+}
+
+/**
+ * hash_64_batch - hash_64() every element of an array
+ * @in: keys to hash
+ * @out: bucket index of each key
+ * @n: number of keys
+ * @bits: log2 of the number of buckets, 1 to 32
+ */
+static inline void hash_64_batch(const uint64_t *in, uint32_t *out, size_t n,
+				 unsigned int bits)
+{
+#ifdef HASH_HAVE_AVX2
+	if (__hash_cpu_has_avx2()) {
+		__hash_64_batch_avx2(in, out, n, bits);
+		return;
+	}
+#endif
+	__hash_64_batch_scalar(in, out, n, bits);
+}
+
+/*
+ * Byte-string hashing, after wyhash by Wang Yi (public domain).
+ *
+ * Keys are consumed 8 bytes at a time (16 or 48 per round) and mixed with
+ * a 64x64->128 bit multiply that folds the high half back into the low
+ * one. Keys of up to 16 bytes are read with at most four overlapping
+ * loads and no loop. Unaligned loads go through memcpy(), which compiles
+ * to a plain mov on targets that allow it.
+ */
+
+static const uint64_t __hash_bytes_secret[4] = {
+	0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+	0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL,
+};
+
+static inline void __hash_mum(uint64_t *a, uint64_t *b)
+{
+	__uint128_t r = (__uint128_t)*a * *b;
+
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t __hash_mix(uint64_t a, uint64_t b)
+{
+	__hash_mum(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t __hash_read8(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t __hash_read4(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/* 1 to 3 bytes */
+static inline uint64_t __hash_read3(const uint8_t *p, size_t k)
+{
+	return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+/**
+ * hash_bytes - hash a variable-length byte string
+ * @data: the bytes to hash
+ * @len: number of bytes
+ * @seed: selects one of 2^64 hash functions, use 0 when you don't care
+ *
+ * Returns a 64-bit hash whose every bit is usable, high bits included, so
+ * it can be reduced with >> like hash_64().
+ */
+static inline uint64_t hash_bytes(const void *data, size_t len, uint64_t seed)
+{
+	const uint64_t *s = __hash_bytes_secret;
+	const uint8_t *p = (const uint8_t *)data;
+	uint64_t a, b;
+	size_t i;
+
+	seed ^= __hash_mix(seed ^ s[0], s[1]);
+
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (__hash_read4(p) << 32) |
+			    __hash_read4(p + ((len >> 3) << 2));
+			b = (__hash_read4(p + len - 4) << 32) |
+			    __hash_read4(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = __hash_read3(p, len);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		i = len;
+		if (i > 48) {
+			uint64_t see1 = seed, see2 = seed;
+
+			do {
+				seed = __hash_mix(__hash_read8(p) ^ s[1],
+						  __hash_read8(p + 8) ^ seed);
+				see1 = __hash_mix(__hash_read8(p + 16) ^ s[2],
+						  __hash_read8(p + 24) ^ see1);
+				see2 = __hash_mix(__hash_read8(p + 32) ^ s[3],
+						  __hash_read8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = __hash_mix(__hash_read8(p) ^ s[1],
+					  __hash_read8(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+		/* last 16 bytes, overlapping what was already mixed */
+		a = __hash_read8(p + i - 16);
+		b = __hash_read8(p + i - 8);
+	}
+
+	a ^= s[1];
+	b ^= seed;
+	__hash_mum(&a, &b);
+
+	return __hash_mix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+/**
+ * hash_bytes_bits - hash a byte string into a table of 2^@bits buckets
+ * @data: the bytes to hash
+ * @len: number of bytes
+ * @bits: log2 of the number of buckets
+ */
+static inline uint32_t hash_bytes_bits(const void *data, size_t len,
+				       unsigned int bits)
+{
+	return (uint32_t)(hash_bytes(data, len, 0) >> (64 - bits));
+}
+
+/*
+ * Keyed hashing for tables fed by untrusted keys.
+ *
+ * hash_32() and hash_64() are fixed multiplications, trivially inverted,
+ * so anyone who picks the keys can put all of them into one bucket.
+ * SipHash (Aumasson & Bernstein) is a PRF under a secret 128-bit key;
+ * without the key an attacker can't aim at a bucket. The 1-3 variant (one
+ * compression round, three finalization rounds) is what most language
+ * runtimes use for their hash tables and is about twice as fast as 2-4.
+ */
+
+struct siphash_key
+{
+	uint64_t key[2];
+};
+
+#define SIPHASH_CONST_0		0x736f6d6570736575ULL
+#define SIPHASH_CONST_1		0x646f72616e646f6dULL
+#define SIPHASH_CONST_2		0x6c7967656e657261ULL
+#define SIPHASH_CONST_3		0x7465646279746573ULL
+
+static inline uint64_t __sip_rol64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+#define SIPROUND(v0, v1, v2, v3)					\
+	do {								\
+		v0 += v1; v1 = __sip_rol64(v1, 13); v1 ^= v0;		\
+		v0 = __sip_rol64(v0, 32);				\
+		v2 += v3; v3 = __sip_rol64(v3, 16); v3 ^= v2;		\
+		v0 += v3; v3 = __sip_rol64(v3, 21); v3 ^= v0;		\
+		v2 += v1; v1 = __sip_rol64(v1, 17); v1 ^= v2;		\
+		v2 = __sip_rol64(v2, 32);				\
+	} while (0)
+
+/* SipHash-c-d over @len bytes, the round counts fold away when inlined */
+static inline uint64_t __siphash(const void *data, size_t len,
+				 const struct siphash_key *key,
+				 int crounds, int drounds)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	const uint8_t *end = p + (len & ~(size_t)7);
+	uint64_t v0 = key->key[0] ^ SIPHASH_CONST_0;
+	uint64_t v1 = key->key[1] ^ SIPHASH_CONST_1;
+	uint64_t v2 = key->key[0] ^ SIPHASH_CONST_2;
+	uint64_t v3 = key->key[1] ^ SIPHASH_CONST_3;
+	uint64_t m, b = (uint64_t)len << 56;
+	int i;
+
+	for (; p != end; p += 8) {
+		m = __hash_read8(p);
+		v3 ^= m;
+		for (i = 0; i < crounds; i++)
+			SIPROUND(v0, v1, v2, v3);
+		v0 ^= m;
+	}
+
+	/* little-endian tail, as in the reference implementation */
+	for (i = len & 7; i > 0; i--)
+		b |= (uint64_t)p[i - 1] << (8 * (i - 1));
+
+	v3 ^= b;
+	for (i = 0; i < crounds; i++)
+		SIPROUND(v0, v1, v2, v3);
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	for (i = 0; i < drounds; i++)
+		SIPROUND(v0, v1, v2, v3);
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * siphash - SipHash-1-3 of a byte string
+ * @data: the bytes to hash
+ * @len: number of bytes
+ * @key: the secret key
+ */
+static inline uint64_t siphash(const void *data, size_t len,
+			       const struct siphash_key *key)
+{
+	return __siphash(data, len, key, 1, 3);
+}
+
+/**
+ * siphash_1u64 - SipHash-1-3 of a single 64-bit word
+ * @first: the word to hash, taken as its 8 little-endian bytes
+ * @key: the secret key
+ */
+static inline uint64_t siphash_1u64(uint64_t first,
+				    const struct siphash_key *key)
+{
+	uint64_t v0 = key->key[0] ^ SIPHASH_CONST_0;
+	uint64_t v1 = key->key[1] ^ SIPHASH_CONST_1;
+	uint64_t v2 = key->key[0] ^ SIPHASH_CONST_2;
+	uint64_t v3 = key->key[1] ^ SIPHASH_CONST_3;
+	uint64_t b = 8ULL << 56;
+
+	v3 ^= first;
+	SIPROUND(v0, v1, v2, v3);
+	v0 ^= first;
+
+	v3 ^= b;
+	SIPROUND(v0, v1, v2, v3);
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+	SIPROUND(v0, v1, v2, v3);
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * siphash_key_init - draw a random key from the kernel
+ * @key: the key to fill in
+ *
+ * Uses getrandom() on Linux and arc4random_buf() on macOS and the BSDs.
+ * Falls back to mixing the clock and ASLR'd addresses if getrandom()
+ * fails or neither exists, which still defeats precomputed collisions.
+ */
+static inline void siphash_key_init(struct siphash_key *key)
+{
+	struct timespec ts;
+
+#if defined(__linux__)
+	if (getrandom(key->key, sizeof(key->key), 0) == sizeof(key->key))
+		return;
+#elif defined(HASH_HAVE_ARC4RANDOM)
+	arc4random_buf(key->key, sizeof(key->key));
+	return;
+#endif
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	key->key[0] = hash_bytes(&ts, sizeof(ts), (uintptr_t)key);
+	key->key[1] = hash_bytes(&ts, sizeof(ts), (uintptr_t)&ts);
+}
+
+/**
+ * hash_keyed - keyed counterpart of hash_min()
+ * @val: integer key, at most 64 bits
+ * @bits: log2 of the number of buckets
+ * @seed: the table's &struct siphash_key
+ */
+#define hash_keyed(val, bits, seed)					\
+	((uint32_t)(siphash_1u64((uint64_t)(val), seed) >> (64 - (bits))))
+
 #endif /* __HASH_H__ */
@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hashtable.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+#define TABLE_BITS 10
+
+struct name
+{
+    char key[32];
+    size_t len;
+    struct hlist_node node;
+};
+
+DEFINE_HASHTABLE(names, TABLE_BITS);
+DEFINE_HASHTABLE(plain, TABLE_BITS);
+DEFINE_KEYED_HASHTABLE(keyed, TABLE_BITS);
+
+struct item
+{
+    uint64_t key;
+    struct hlist_node node;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* the byte-at-a-time hash callers tend to write by hand */
+static uint64_t fnv1a(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+static void report(const char *name, bool ok)
+{
+    printf("%-28s", name);
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/* same bytes at any alignment hash the same, seeds and lengths differ */
+void TEST_HASH_BYTES()
+{
+    char buf[128 + 8];
+    const char *s = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    uint64_t h, prev = 0;
+    size_t len, off;
+    bool ok = true;
+
+    for (len = 0; len <= strlen(s); len++) {
+        h = hash_bytes(s, len, 0);
+        for (off = 1; off < 8; off++) {
+            memcpy(buf + off, s, len);
+            if (hash_bytes(buf + off, len, 0) != h)
+                ok = false;
+        }
+        if (hash_bytes(s, len, 1) == h || h == prev)
+            ok = false;
+        prev = h;
+    }
+
+    report("TEST_HASH_BYTES", ok);
+}
+
+/*
+ * sequential identifiers through hash_add_bytes(): the longest chain
+ * should stay close to what a random function gives
+ */
+void TEST_HASH_ADD_BYTES()
+{
+    int n = 8 << TABLE_BITS, i, len, max = 0;
+    struct name *items = (struct name *)malloc(sizeof(struct name) * n);
+    struct name *obj;
+    unsigned int bkt;
+    bool ok = true;
+
+    for (i = 0; i < n; i++) {
+        items[i].len = snprintf(items[i].key, sizeof(items[i].key),
+                                "session-%08d", i);
+        hash_add_bytes(names, &items[i].node, items[i].key, items[i].len);
+    }
+
+    for (i = 0; i < n; i++) {
+        bool found = false;
+
+        hash_for_each_possible_bytes(names, obj, node, items[i].key,
+                                     items[i].len) {
+            if (obj->len == items[i].len &&
+                !memcmp(obj->key, items[i].key, obj->len)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            ok = false;
+    }
+
+    for (bkt = 0; bkt < HASH_SIZE(names); bkt++) {
+        len = 0;
+        hlist_for_each_entry(obj, &names[bkt], node)
+            len++;
+        if (len > max)
+            max = len;
+    }
+    /* mean chain is 8, a uniform hash stays well under 3x that */
+    if (max > 24)
+        ok = false;
+
+    printf("%-28s max chain %d (mean %d) ", "TEST_HASH_ADD_BYTES", max,
+           n >> TABLE_BITS);
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+
+    free(items);
+}
+
+/* throughput per key length, hash_bytes() against a byte loop */
+void compare_hash(int n)
+{
+    static const size_t lens[] = { 4, 8, 12, 16, 24, 32, 48, 64, 128, 1024 };
+    size_t i, k, nkeys = 1024;
+    char *buf = (char *)malloc(nkeys * 1024);
+    volatile uint64_t sink = 0;
+    double t, tb, tf;
+    int r;
+
+    for (i = 0; i < nkeys * 1024; i++)
+        buf[i] = rand();
+
+    printf("%-8s%-18s%-18s%-18s%-10s\n", "Len", "hash_bytes(ns)",
+           "hash_bytes(GB/s)", "fnv1a(ns)", "Speedup");
+    for (k = 0; k < sizeof(lens) / sizeof(lens[0]); k++) {
+        t = now();
+        for (r = 0; r < n; r++)
+            sink += hash_bytes(buf + (r % nkeys) * lens[k], lens[k], 0);
+        tb = now() - t;
+
+        t = now();
+        for (r = 0; r < n; r++)
+            sink += fnv1a(buf + (r % nkeys) * lens[k], lens[k]);
+        tf = now() - t;
+
+        printf("%-8zu%-18.2f%-18.2f%-18.2f%-10.2f\n", lens[k], tb * 1e9 / n,
+               lens[k] * (double)n / tb / 1e9, tf * 1e9 / n, tf / tb);
+    }
+
+    free(buf);
+}
+
+/* every path must agree with hash_32()/hash_64() for every width */
+void TEST_HASH_BATCH()
+{
+    size_t n = 1000, i;
+    uint32_t *in32 = (uint32_t *)malloc(n * sizeof(uint32_t));
+    uint64_t *in64 = (uint64_t *)malloc(n * sizeof(uint64_t));
+    uint32_t *out = (uint32_t *)malloc(n * sizeof(uint32_t));
+    unsigned int bits;
+    bool ok = true;
+
+    for (i = 0; i < n; i++) {
+        in32[i] = rand() ^ ((uint32_t)rand() << 16);
+        in64[i] = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+    }
+
+    for (bits = 1; bits <= 32; bits++) {
+        /* odd length leaves a scalar tail */
+        hash_32_batch(in32, out, n - 3, bits);
+        for (i = 0; i < n - 3; i++)
+            if (out[i] != hash_32(in32[i], bits))
+                ok = false;
+
+        hash_64_batch(in64, out, n - 3, bits);
+        for (i = 0; i < n - 3; i++)
+            if (out[i] != (uint32_t)hash_64(in64[i], bits))
+                ok = false;
+    }
+
+    printf("%-28s %-8s", "TEST_HASH_BATCH",
+           __hash_cpu_has_avx2() ? "avx2" : "scalar");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+
+    free(in32);
+    free(in64);
+    free(out);
+}
+
+/* keys/sec: one call per key, batched scalar, batched AVX2 */
+void compare_batch(int n)
+{
+    uint32_t *in32 = (uint32_t *)malloc(n * sizeof(uint32_t));
+    uint64_t *in64 = (uint64_t *)malloc(n * sizeof(uint64_t));
+    uint32_t *out = (uint32_t *)malloc(n * sizeof(uint32_t));
+    double t, one32, one64, sc32, sc64, av32 = 0, av64 = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        in32[i] = rand();
+        in64[i] = ((uint64_t)rand() << 32) ^ rand();
+    }
+    /* fault the output in before timing anything */
+    memset(out, 0, n * sizeof(uint32_t));
+
+    t = now();
+    for (i = 0; i < n; i++)
+        out[i] = hash_32(in32[i], 20);
+    one32 = now() - t;
+    t = now();
+    for (i = 0; i < n; i++)
+        out[i] = hash_64(in64[i], 20);
+    one64 = now() - t;
+
+    t = now();
+    __hash_32_batch_scalar(in32, out, n, 20);
+    sc32 = now() - t;
+    t = now();
+    __hash_64_batch_scalar(in64, out, n, 20);
+    sc64 = now() - t;
+
+#ifdef HASH_HAVE_AVX2
+    if (__hash_cpu_has_avx2()) {
+        t = now();
+        __hash_32_batch_avx2(in32, out, n, 20);
+        av32 = now() - t;
+        t = now();
+        __hash_64_batch_avx2(in64, out, n, 20);
+        av64 = now() - t;
+    }
+#endif
+
+    printf("%-12s%-18s%-18s%-18s (Mkeys/s)\n", "Function", "Per-key",
+           "Batch scalar", "Batch AVX2");
+    printf("%-12s%-18.1f%-18.1f%-18.1f\n", "hash_32", n / one32 / 1e6,
+           n / sc32 / 1e6, av32 ? n / av32 / 1e6 : 0);
+    printf("%-12s%-18.1f%-18.1f%-18.1f\n", "hash_64", n / one64 / 1e6,
+           n / sc64 / 1e6, av64 ? n / av64 / 1e6 : 0);
+
+    free(in32);
+    free(in64);
+    free(out);
+}
+
+/* SipHash-2-4 reference vectors, key 00..0f, message 00 01 02 ... */
+void TEST_SIPHASH()
+{
+    static const struct { size_t len; uint64_t hash; } vec[] = {
+        { 0,  0x726fdb47dd0e0e31ULL },
+        { 1,  0x74f839c593dc67fdULL },
+        { 8,  0x93f5f5799a932462ULL },
+        { 15, 0xa129ca6149be45e5ULL },
+    };
+    struct siphash_key k;
+    uint8_t msg[16];
+    uint64_t x = 0x0123456789abcdefULL;
+    bool ok = true;
+    size_t i;
+
+    for (i = 0; i < 16; i++)
+        msg[i] = i;
+    memcpy(k.key, msg, sizeof(k.key));
+
+    for (i = 0; i < sizeof(vec) / sizeof(vec[0]); i++)
+        if (__siphash(msg, vec[i].len, &k, 2, 4) != vec[i].hash)
+            ok = false;
+
+    if (siphash_1u64(x, &k) != siphash(&x, sizeof(x), &k))
+        ok = false;
+
+    report("TEST_SIPHASH", ok);
+}
+
+/* modular inverse of an odd 64-bit constant by Newton iteration */
+static uint64_t inverse64(uint64_t a)
+{
+    uint64_t x = a;
+    int i;
+
+    for (i = 0; i < 5; i++)
+        x *= 2 - a * x;
+
+    return x;
+}
+
+static double time_lookups(struct item *items, int n, int use_keyed)
+{
+    struct item *obj;
+    unsigned long found = 0;
+    double t = now();
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (use_keyed) {
+            hash_for_each_possible_keyed(keyed, obj, node, items[i].key)
+                if (obj->key == items[i].key) {
+                    found++;
+                    break;
+                }
+        } else {
+            hash_for_each_possible(plain, obj, node, items[i].key)
+                if (obj->key == items[i].key) {
+                    found++;
+                    break;
+                }
+        }
+    }
+    t = now() - t;
+
+    if (found != (unsigned long)n)
+        printf(KRED "lookup mismatch: %lu\n" RESET, found);
+
+    return t;
+}
+
+static int max_chain(struct hlist_head *table, unsigned int sz)
+{
+    struct item *obj;
+    unsigned int bkt;
+    int len, max = 0;
+
+    for (bkt = 0; bkt < sz; bkt++) {
+        len = 0;
+        hlist_for_each_entry(obj, &table[bkt], node)
+            len++;
+        if (len > max)
+            max = len;
+    }
+
+    return max;
+}
+
+/*
+ * cost of the keyed hash on random keys, and what it buys against keys
+ * chosen to collide under hash_64(): k * inverse(prime) hashes to k, so
+ * every small k lands in bucket 0 of the plain table
+ */
+void compare_keyed(int n)
+{
+    struct item *rnd = (struct item *)malloc(sizeof(struct item) * n);
+    struct item *evil = (struct item *)malloc(sizeof(struct item) * n);
+    struct item *rnd2 = (struct item *)malloc(sizeof(struct item) * n);
+    struct item *evil2 = (struct item *)malloc(sizeof(struct item) * n);
+    uint64_t inv = inverse64(GOLDEN_RATIO_PRIME_64);
+    volatile uint64_t sink = 0;
+    double t, th, ts;
+    int i;
+
+    hash_init(plain);
+    hash_init_keyed(keyed);
+
+    t = now();
+    for (i = 0; i < n; i++)
+        sink += hash_64(i, TABLE_BITS);
+    th = now() - t;
+    t = now();
+    for (i = 0; i < n; i++)
+        sink += hash_keyed(i, TABLE_BITS, &keyed_seed);
+    ts = now() - t;
+    printf("%-24s%-14s%-14s\n", "ns/hash", "hash_64", "siphash13");
+    printf("%-24s%-14.2f%-14.2f\n", "", th * 1e9 / n, ts * 1e9 / n);
+
+    for (i = 0; i < n; i++) {
+        rnd[i].key = rnd2[i].key =
+            ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+        evil[i].key = evil2[i].key = (uint64_t)i * inv;
+    }
+
+    printf("%-24s%-14s%-14s%-14s\n", "Workload", "Table", "Max chain",
+           "Lookup(ns)");
+
+    for (i = 0; i < n; i++) {
+        hash_add(plain, &rnd[i].node, rnd[i].key);
+        hash_add_keyed(keyed, &rnd2[i].node, rnd2[i].key);
+    }
+    t = time_lookups(rnd, n, 0);
+    printf("%-24s%-14s%-14d%-14.1f\n", "random keys", "hash_min",
+           max_chain(plain, HASH_SIZE(plain)), t * 1e9 / n);
+    t = time_lookups(rnd2, n, 1);
+    printf("%-24s%-14s%-14d%-14.1f\n", "random keys", "keyed",
+           max_chain(keyed, HASH_SIZE(keyed)), t * 1e9 / n);
+
+    hash_init(plain);
+    hash_init_keyed(keyed);
+    for (i = 0; i < n; i++) {
+        hash_add(plain, &evil[i].node, evil[i].key);
+        hash_add_keyed(keyed, &evil2[i].node, evil2[i].key);
+    }
+    t = time_lookups(evil, n, 0);
+    printf("%-24s%-14s%-14d%-14.1f\n", "colliding keys", "hash_min",
+           max_chain(plain, HASH_SIZE(plain)), t * 1e9 / n);
+    t = time_lookups(evil2, n, 1);
+    printf("%-24s%-14s%-14d%-14.1f\n", "colliding keys", "keyed",
+           max_chain(keyed, HASH_SIZE(keyed)), t * 1e9 / n);
+
+    free(rnd);
+    free(evil);
+    free(rnd2);
+    free(evil2);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <nhashes>\n", argv[0]);
+        exit(1);
+    }
+
+    TEST_HASH_BYTES();
+    TEST_HASH_ADD_BYTES();
+    TEST_HASH_BATCH();
+    TEST_SIPHASH();
+    compare_hash(atoi(argv[1]));
+    compare_batch(atoi(argv[1]));
+    compare_keyed(20000);
+
+    return 0;
+}
@@ -0,0 +1,372 @@
+#ifndef __HASHIMAGE_H__
+#define __HASHIMAGE_H__
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hashtable.h"
+
+/*
+ * Persistent hashtable images.
+ *
+ * himg_write() dumps a DEFINE_HASHTABLE() table to a file in a layout
+ * without pointers: a header, the records, then the bucket array. Every
+ * link is a byte offset from the start of the file (0 meaning none),
+ * so himg_open() only has to map the file and check the header; lookups
+ * then run directly on the mapping and only the pages they touch are ever
+ * read from disk. Nothing is rebuilt or deserialized on a restart.
+ *
+ *	record:	next offset | key | value length | value bytes, padded to 8
+ *
+ * The caller's callback turns each object into a 64-bit key and a value
+ * blob; the image hashes keys with hash_64() into as many buckets as the
+ * source table had. The header carries a format version, a checksum of
+ * itself, and a checksum of the rest of the file that himg_verify() checks
+ * on request, since checking it on every open would fault in every page.
+ */
+
+#define HIMG_MAGIC		0x474d49485348ULL	/* "HSHIMG" */
+#define HIMG_VERSION		1
+#define HIMG_BLOCK		65536	/* checksum block size */
+
+struct himg_header
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t bits;			/* log2 of the number of buckets */
+	uint64_t nentries;
+	uint64_t size;			/* bytes in the whole file */
+	uint64_t buckets_off;
+	uint64_t checksum;		/* of every byte after the header */
+	uint64_t hdr_checksum;		/* of the header up to this field */
+	uint64_t reserved;
+};
+
+struct himg_rec
+{
+	uint64_t next;
+	uint64_t key;
+	uint64_t len;
+	unsigned char val[];
+};
+
+struct himg
+{
+	const struct himg_header *hdr;
+	const uint64_t *buckets;
+	const char *base;
+};
+
+/*
+ * Fill in @key and point @val at the bytes to store for the object whose
+ * node is @node; returns the number of bytes.
+ */
+typedef size_t (*himg_record_fn)(const struct hlist_node *node,
+				 uint64_t *key, const void **val);
+
+static inline uint64_t __himg_hdr_checksum(const struct himg_header *hdr)
+{
+	return hash_bytes(hdr, offsetof(struct himg_header, hdr_checksum), 0);
+}
+
+/* checksum of the bytes after the header, hashed in HIMG_BLOCK blocks */
+static inline uint64_t __himg_checksum(const char *p, size_t len)
+{
+	uint64_t csum = HIMG_VERSION;
+	size_t n;
+
+	for (; len; p += n, len -= n) {
+		n = len < HIMG_BLOCK ? len : HIMG_BLOCK;
+		csum = hash_bytes(p, n, csum);
+	}
+
+	return csum;
+}
+
+/* buffered output that checksums exactly the blocks __himg_checksum() sees */
+struct __himg_out
+{
+	FILE *f;
+	uint64_t csum;
+	uint64_t off;			/* file offset of the next byte */
+	size_t fill;
+	char buf[HIMG_BLOCK];
+};
+
+static inline int __himg_flush(struct __himg_out *out)
+{
+	if (!out->fill)
+		return 0;
+	out->csum = hash_bytes(out->buf, out->fill, out->csum);
+	if (fwrite(out->buf, 1, out->fill, out->f) != out->fill)
+		return -EIO;
+	out->fill = 0;
+	return 0;
+}
+
+static inline int __himg_put(struct __himg_out *out, const void *data,
+			     size_t len)
+{
+	const char *p = (const char *)data;
+	size_t n;
+
+	for (; len; p += n, len -= n) {
+		n = HIMG_BLOCK - out->fill;
+		if (n > len)
+			n = len;
+		memcpy(out->buf + out->fill, p, n);
+		out->fill += n;
+		out->off += n;
+		if (out->fill == HIMG_BLOCK && __himg_flush(out))
+			return -EIO;
+	}
+
+	return 0;
+}
+
+static inline int __himg_write(const char *path, struct hlist_head *ht,
+			       unsigned int sz, unsigned int bits,
+			       himg_record_fn fn)
+{
+	static const uint64_t zero;
+	struct himg_header hdr = { 0 };
+	struct __himg_out *out;
+	struct hlist_node *pos;
+	struct himg_rec rec;
+	uint64_t *heads;
+	const void *val;
+	unsigned int i;
+	uint64_t b;
+	int ret = -ENOMEM;
+
+	heads = (uint64_t *)calloc(sz, sizeof(uint64_t));
+	out = (struct __himg_out *)malloc(sizeof(*out));
+	if (!heads || !out)
+		goto out_free;
+
+	out->f = fopen(path, "wb");
+	if (!out->f) {
+		ret = -errno;
+		goto out_free;
+	}
+	out->csum = HIMG_VERSION;
+	out->fill = 0;
+	out->off = sizeof(hdr);
+	ret = -EIO;
+	if (fwrite(&hdr, sizeof(hdr), 1, out->f) != 1)
+		goto out_close;
+
+	/* each record links to the previous one of its bucket */
+	for (i = 0; i < sz; i++) {
+		hlist_for_each(pos, &ht[i]) {
+			rec.len = fn(pos, &rec.key, &val);
+			b = hash_64(rec.key, bits);
+			rec.next = heads[b];
+			heads[b] = out->off;
+			if (__himg_put(out, &rec, sizeof(rec)) ||
+			    __himg_put(out, val, rec.len) ||
+			    __himg_put(out, &zero, -rec.len & 7))
+				goto out_close;
+			hdr.nentries++;
+		}
+	}
+
+	hdr.buckets_off = out->off;
+	if (__himg_put(out, heads, sizeof(uint64_t) * sz) || __himg_flush(out))
+		goto out_close;
+
+	hdr.magic = HIMG_MAGIC;
+	hdr.version = HIMG_VERSION;
+	hdr.bits = bits;
+	hdr.size = out->off;
+	hdr.checksum = out->csum;
+	hdr.hdr_checksum = __himg_hdr_checksum(&hdr);
+	if (fseek(out->f, 0, SEEK_SET) ||
+	    fwrite(&hdr, sizeof(hdr), 1, out->f) != 1)
+		goto out_close;
+	ret = 0;
+
+out_close:
+	if (fclose(out->f) && !ret)
+		ret = -errno;
+out_free:
+	free(heads);
+	free(out);
+	return ret;
+}
+
+/**
+ * himg_write - write a hashtable image to a file
+ * @path: file to create or truncate
+ * @hashtable: populated hashtable, left untouched
+ * @fn: &himg_record_fn giving the key and value bytes of each object
+ *
+ * Returns 0 on success and -errno on failure.
+ */
+#define himg_write(path, hashtable, fn)					\
+	__himg_write(path, hashtable, HASH_SIZE(hashtable),		\
+		     HASH_BITS(hashtable), fn)
+
+/**
+ * himg_open - map a hashtable image for queries
+ * @img: the image handle to set up
+ * @path: file written by himg_write()
+ *
+ * Maps the file read-only and checks only its header, so no other page is
+ * read until a lookup needs it. Returns 0 on success, -EINVAL if the file
+ * isn't an intact image of this format version and -errno if it can't be
+ * opened or mapped.
+ */
+static inline int himg_open(struct himg *img, const char *path)
+{
+	const struct himg_header *hdr;
+	struct stat st;
+	int fd, ret = 0;
+	void *base;
+
+	img->hdr = NULL;
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st)) {
+		ret = -errno;
+		goto out;
+	}
+	if ((size_t)st.st_size < sizeof(struct himg_header)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		ret = -errno;
+		goto out;
+	}
+	/* hash lookups jump around, read-ahead would only waste I/O */
+	madvise(base, st.st_size, MADV_RANDOM);
+
+	hdr = (const struct himg_header *)base;
+	if (hdr->magic != HIMG_MAGIC || hdr->version != HIMG_VERSION ||
+	    hdr->hdr_checksum != __himg_hdr_checksum(hdr) ||
+	    hdr->size != (uint64_t)st.st_size || hdr->bits > 31 ||
+	    hdr->buckets_off < sizeof(struct himg_header) ||
+	    hdr->buckets_off + (sizeof(uint64_t) << hdr->bits) != hdr->size) {
+		munmap(base, st.st_size);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	img->hdr = hdr;
+	img->base = (const char *)base;
+	img->buckets = (const uint64_t *)(img->base + hdr->buckets_off);
+out:
+	close(fd);
+	return ret;
+}
+
+/**
+ * himg_close - unmap a hashtable image
+ * @img: the image to close
+ */
+static inline void himg_close(struct himg *img)
+{
+	if (img->hdr)
+		munmap((void *)img->hdr, img->hdr->size);
+	img->hdr = NULL;
+}
+
+/**
+ * himg_verify - check the checksum of a whole hashtable image
+ * @img: the open image
+ *
+ * Reads every page of the file. Returns true if it is intact.
+ */
+static inline bool himg_verify(const struct himg *img)
+{
+	return __himg_checksum(img->base + sizeof(struct himg_header),
+			       img->hdr->size - sizeof(struct himg_header)) ==
+	       img->hdr->checksum;
+}
+
+static inline unsigned long himg_count(const struct himg *img)
+{
+	return img->hdr->nentries;
+}
+
+static inline uint64_t __himg_off(const struct himg *img,
+				  const struct himg_rec *rec)
+{
+	return (const char *)rec - img->base;
+}
+
+/*
+ * Record at @off, or NULL for 0, for records that would run into the
+ * bucket array and for offsets not below @below. himg_write() only links
+ * a record to one written before it, so chains walk towards the header
+ * and a damaged image can end a chain early but never make a walk leave
+ * the mapping or loop.
+ */
+static inline const struct himg_rec *__himg_rec(const struct himg *img,
+						uint64_t off, uint64_t below)
+{
+	uint64_t end = img->hdr->buckets_off;
+	const struct himg_rec *rec;
+
+	if (!off || (off & 7) || off < sizeof(struct himg_header) ||
+	    off >= below || off > end - sizeof(struct himg_rec))
+		return NULL;
+	rec = (const struct himg_rec *)(img->base + off);
+	if (rec->len > end - off - sizeof(struct himg_rec))
+		return NULL;
+	return rec;
+}
+
+/**
+ * himg_lookup - find the value stored under @key
+ * @img: the open image
+ * @key: the key to look up
+ * @len: if not NULL, receives the length of the value
+ *
+ * Returns a pointer into the mapping, valid until himg_close(), or NULL.
+ */
+static inline const void *himg_lookup(const struct himg *img, uint64_t key,
+				      size_t *len)
+{
+	const struct himg_rec *rec;
+
+	for (rec = __himg_rec(img, img->buckets[hash_64(key, img->hdr->bits)],
+			      img->hdr->buckets_off);
+	     rec; rec = __himg_rec(img, rec->next, __himg_off(img, rec))) {
+		if (rec->key == key) {
+			if (len)
+				*len = rec->len;
+			return rec->val;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * himg_for_each - iterate over the records of a hashtable image
+ * @img: the open image
+ * @bkt: unsigned long to use as bucket loop cursor
+ * @rec: the const struct himg_rec * to use as a loop cursor
+ */
+#define himg_for_each(img, bkt, rec)					\
+	for ((bkt) = 0, rec = NULL;					\
+	     rec == NULL && (bkt) < (1UL << (img)->hdr->bits); (bkt)++)	\
+		for (rec = __himg_rec(img, (img)->buckets[bkt],	\
+				      (img)->hdr->buckets_off); rec;	\
+		     rec = __himg_rec(img, (rec)->next, __himg_off(img, rec)))
+
+#endif /* __HASHIMAGE_H__ */
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hashimage.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+#define TABLE_BITS 20
+#define IMAGE      "/tmp/hashimage_test.img"
+#define DUMP       "/tmp/hashimage_test.dump"
+
+struct item
+{
+    uint64_t key;
+    struct hlist_node node;
+    char payload[40];
+};
+
+DEFINE_HASHTABLE(table, TABLE_BITS);
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+}
+
+static struct item *lookup(uint64_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible(table, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+/* payloads are NUL terminated strings of varying length */
+static size_t record(const struct hlist_node *node, uint64_t *key,
+                     const void **val)
+{
+    const struct item *obj = hlist_entry(node, struct item, node);
+
+    *key = obj->key;
+    *val = obj->payload;
+    return strlen(obj->payload) + 1;
+}
+
+static void fill(struct item *items, int n)
+{
+    int i;
+
+    hash_init(table);
+    for (i = 0; i < n; i++) {
+        items[i].key = rand64();
+        snprintf(items[i].payload, sizeof(items[i].payload), "item-%d-%0*d",
+                 i, i % 24, 0);
+        hash_add(table, &items[i].node, items[i].key);
+    }
+}
+
+/* overwrite @len bytes of IMAGE at @off */
+static void patch(off_t off, const void *data, size_t len)
+{
+    int fd = open(IMAGE, O_WRONLY);
+
+    if (fd < 0 || pwrite(fd, data, len, off) != (ssize_t)len) {
+        fprintf(stderr, "can't patch %s\n", IMAGE);
+        exit(1);
+    }
+    close(fd);
+}
+
+void TEST_HIMG(struct item *items, int n)
+{
+    const struct himg_rec *rec;
+    struct himg_rec first;
+    struct himg_header hdr;
+    struct himg img;
+    unsigned long bkt, seen = 0;
+    uint64_t next;
+    const char *val;
+    size_t len;
+    bool ok = true;
+    int i;
+
+    if (himg_write(IMAGE, table, record) || himg_open(&img, IMAGE)) {
+        printf("%-28s" KRED "\tFAILED\n" RESET, "TEST_HIMG");
+        return;
+    }
+    if (himg_count(&img) != (unsigned long)n || !himg_verify(&img))
+        ok = false;
+    for (i = 0; i < n; i++) {
+        val = (const char *)himg_lookup(&img, items[i].key, &len);
+        if (!val || len != strlen(items[i].payload) + 1 ||
+            strcmp(val, items[i].payload))
+            ok = false;
+    }
+    for (i = 0; i < 1000; i++) {
+        uint64_t k = rand64();
+
+        if ((himg_lookup(&img, k, NULL) != NULL) != (lookup(k) != NULL))
+            ok = false;
+    }
+    himg_for_each(&img, bkt, rec) {
+        if (!lookup(rec->key))
+            ok = false;
+        seen++;
+    }
+    if (seen != (unsigned long)n)
+        ok = false;
+    hdr = *img.hdr;
+    first = *(const struct himg_rec *)(img.base + sizeof(hdr));
+    himg_close(&img);
+
+    /*
+     * the header checksum doesn't cover records: a record linked to itself
+     * opens fine, but walks stop at it instead of looping
+     */
+    next = sizeof(hdr);
+    patch(sizeof(hdr) + offsetof(struct himg_rec, next), &next, sizeof(next));
+    if (himg_open(&img, IMAGE)) {
+        ok = false;
+    } else {
+        seen = 0;
+        himg_for_each(&img, bkt, rec)
+            seen++;
+        if (seen != (unsigned long)n || himg_verify(&img) ||
+            !himg_lookup(&img, first.key, NULL))
+            ok = false;
+        for (i = 0; i < 1000; i++)
+            himg_lookup(&img, rand64(), NULL);
+        himg_close(&img);
+    }
+    patch(sizeof(hdr) + offsetof(struct himg_rec, next), &first.next,
+          sizeof(first.next));
+
+    /* a flipped byte in a record is caught by the full checksum */
+    patch(sizeof(hdr) + sizeof(struct himg_rec), "#", 1);
+    if (himg_open(&img, IMAGE)) {
+        ok = false;
+    } else {
+        if (himg_verify(&img))
+            ok = false;
+        himg_close(&img);
+    }
+
+    /* a damaged header or another format version is refused on open */
+    hdr.nentries++;
+    patch(0, &hdr, sizeof(hdr));
+    if (himg_open(&img, IMAGE) != -EINVAL)
+        ok = false;
+    hdr.nentries--;
+    hdr.version = HIMG_VERSION + 1;
+    hdr.hdr_checksum = __himg_hdr_checksum(&hdr);
+    patch(0, &hdr, sizeof(hdr));
+    if (himg_open(&img, IMAGE) != -EINVAL)
+        ok = false;
+    unlink(IMAGE);
+
+    printf("%-28s", "TEST_HIMG");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/*
+ * Time until a restarted process answers its first @nq queries: reading a
+ * flat dump of the objects back and rehashing them, against mapping the
+ * image and looking up straight away.
+ */
+void compare_restart(struct item *items, int n, int nq)
+{
+    struct item *copy = (struct item *)malloc(sizeof(struct item) * n);
+    uint64_t *keys = (uint64_t *)malloc(sizeof(uint64_t) * nq);
+    unsigned long found = 0;
+    struct himg img;
+    double tw, tr, to, tq;
+    FILE *f;
+    int i;
+
+    for (i = 0; i < nq; i++)
+        keys[i] = items[rand() % n].key;
+
+    tw = now();
+    if (himg_write(IMAGE, table, record)) {
+        fprintf(stderr, "can't write %s\n", IMAGE);
+        exit(1);
+    }
+    tw = now() - tw;
+    f = fopen(DUMP, "wb");
+    if (!f || fwrite(items, sizeof(struct item), n, f) != (size_t)n) {
+        fprintf(stderr, "can't write %s\n", DUMP);
+        exit(1);
+    }
+    fclose(f);
+
+    tr = now();
+    f = fopen(DUMP, "rb");
+    if (!f || fread(copy, sizeof(struct item), n, f) != (size_t)n) {
+        fprintf(stderr, "can't read %s\n", DUMP);
+        exit(1);
+    }
+    fclose(f);
+    hash_init(table);
+    for (i = 0; i < n; i++)
+        hash_add(table, &copy[i].node, copy[i].key);
+    for (i = 0; i < nq; i++)
+        found += lookup(keys[i]) != NULL;
+    tr = now() - tr;
+
+    to = now();
+    if (himg_open(&img, IMAGE)) {
+        fprintf(stderr, "can't open %s\n", IMAGE);
+        exit(1);
+    }
+    to = now() - to;
+    tq = now();
+    for (i = 0; i < nq; i++)
+        found += himg_lookup(&img, keys[i], NULL) != NULL;
+    tq = now() - tq;
+
+    printf("%-10s%-12s%-14s%-12s%-16s%-12s\n", "Objects", "Write(ms)",
+           "Rebuild(ms)", "Open(us)", "Queries(ms)", "Image B/key");
+    printf("%-10d%-12.1f%-14.1f%-12.1f%-16.3f%-12.1f\n", n, tw * 1e3,
+           tr * 1e3, to * 1e6, tq * 1e3, (double)img.hdr->size / n);
+    if (found != 2UL * nq)
+        printf(KRED "%lu of %d lookups found\n" RESET, found, 2 * nq);
+
+    himg_close(&img);
+    unlink(IMAGE);
+    unlink(DUMP);
+    free(keys);
+    free(copy);
+}
+
+int main(int argc, char **argv)
+{
+    struct item *items;
+    int n;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <nobjects> <nqueries>\n", argv[0]);
+        exit(1);
+    }
+    n = atoi(argv[1]);
+
+    srand((unsigned)time(0));
+    items = (struct item *)malloc(sizeof(struct item) * n);
+    fill(items, n);
+
+    TEST_HIMG(items, n);
+    compare_restart(items, n, atoi(argv[2]));
+
+    free(items);
+    return 0;
+}
@@ -1,6 +1,30 @@
 #ifndef __HASHTABLE_H__
 #define __HASHTABLE_H__
 
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hash.h"
+#include "rcu.h"
+
+#ifndef container_of
+#define container_of(ptr, type, member) ({ \
+        const typeof(((type *)0)->member) *__mptr = (ptr); \
+        (type *)((char *)(__mptr) - offsetof(type, member)); })
+#endif
+
+/*
+ * Non-NULL pointers that will fault if dereferenced, used to poison
+ * the links of deleted entries.
+ */
+#ifndef LIST_POISON1
+#define LIST_POISON1  ((void *) 0x00100100)
+#define LIST_POISON2  ((void *) 0x00200200)
+#endif
+
 /*
  * Double linked lists with a single pointer list head.
  * Mostly useful for hash tables where the two pointer list head is
@@ -41,7 +65,8 @@ static inline void __hlist_del(struct hlist_node *n)
 {
 	struct hlist_node *next = n->next;
 	struct hlist_node **pprev = n->pprev;
-	*pprev = next;
+
+	WRITE_ONCE(*pprev, next);
 	if (next)
 		next->pprev = pprev;
 }
@@ -169,6 +194,292 @@ static inline void hlist_move_list(struct hlist_head *old,
 
 
 
+/*
+ * RCU variants of the hlist primitives. Updaters must still serialize
+ * against each other; readers may walk the list concurrently inside
+ * rcu_read_lock()/rcu_read_unlock() without taking any lock.
+ */
+
+#define hlist_first_rcu(head)	(*((struct hlist_node **)(&(head)->first)))
+#define hlist_next_rcu(node)	(*((struct hlist_node **)(&(node)->next)))
+
+/**
+ * hlist_add_head_rcu - adds the specified element to the specified hlist,
+ * while permitting racing traversals.
+ * @n: the element to add to the hash list.
+ * @h: the list to add to.
+ *
+ * The element is fully initialized before rcu_assign_pointer() publishes
+ * it, so a concurrent hlist_for_each_entry_rcu() sees either the old or
+ * the new list, never a half-linked node.
+ */
+static inline void hlist_add_head_rcu(struct hlist_node *n,
+				      struct hlist_head *h)
+{
+	struct hlist_node *first = h->first;
+
+	n->next = first;
+	n->pprev = &h->first;
+	rcu_assign_pointer(hlist_first_rcu(h), n);
+	if (first)
+		first->pprev = &n->next;
+}
+
+/**
+ * hlist_add_behind_rcu - add @n after @prev while permitting racing
+ * traversals.
+ * @n: the new element to add to the hash list.
+ * @prev: the existing element to add the new element after.
+ */
+static inline void hlist_add_behind_rcu(struct hlist_node *n,
+					struct hlist_node *prev)
+{
+	n->next = prev->next;
+	n->pprev = &prev->next;
+	rcu_assign_pointer(hlist_next_rcu(prev), n);
+	if (n->next)
+		n->next->pprev = &n->next;
+}
+
+/**
+ * hlist_del_rcu - deletes entry from hash list without re-initialization
+ * @n: the element to delete from the hash list.
+ *
+ * ->next is left intact so that readers currently on @n can carry on
+ * walking; the caller must wait for a grace period (synchronize_rcu() or
+ * call_rcu()) before freeing or reusing @n.
+ */
+static inline void hlist_del_rcu(struct hlist_node *n)
+{
+	__hlist_del(n);
+	WRITE_ONCE(n->pprev, LIST_POISON2);
+}
+
+/**
+ * hlist_del_init_rcu - deletes entry from hash list with re-initialization
+ * @n: the element to delete from the hash list.
+ *
+ * Like hlist_del_rcu(), but leaves hlist_unhashed() true afterwards.
+ */
+static inline void hlist_del_init_rcu(struct hlist_node *n)
+{
+	if (!hlist_unhashed(n)) {
+		__hlist_del(n);
+		WRITE_ONCE(n->pprev, NULL);
+	}
+}
+
+/**
+ * hlist_replace_rcu - replace old entry by new one
+ * @old: the element to be replaced
+ * @new: the new element to insert
+ */
+static inline void hlist_replace_rcu(struct hlist_node *old,
+				     struct hlist_node *new)
+{
+	struct hlist_node *next = old->next;
+
+	new->next = next;
+	new->pprev = old->pprev;
+	rcu_assign_pointer(*(struct hlist_node **)new->pprev, new);
+	if (next)
+		next->pprev = &new->next;
+	WRITE_ONCE(old->pprev, LIST_POISON2);
+}
+
+/**
+ * hlist_for_each_entry_rcu - iterate over rcu list of given type
+ * @pos:	the type * to use as a loop cursor.
+ * @head:	the head for your list.
+ * @member:	the name of the hlist_node within the struct.
+ *
+ * Must run inside rcu_read_lock()/rcu_read_unlock().
+ */
+#define hlist_for_each_entry_rcu(pos, head, member)			\
+	for (pos = hlist_entry_safe(rcu_dereference(hlist_first_rcu(head)),\
+			typeof(*(pos)), member);				\
+	     pos;							\
+	     pos = hlist_entry_safe(rcu_dereference(hlist_next_rcu(		\
+			&(pos)->member)), typeof(*(pos)), member))
+
+/*
+ * Lookup probe counters, compiled in with -DHASHTABLE_STATS.
+ *
+ * Every hash_for_each_possible*() walk counts one lookup, and every node
+ * it visits counts one probe. probes / lookups is the average number of
+ * nodes a lookup compares, which is what shows up when a table is
+ * undersized or its keys cluster. Without HASHTABLE_STATS the walks
+ * compile to plain hlist iteration.
+ *
+ * Each thread counts into its own cache line with plain stores, so the
+ * counters can stay on under concurrent lookups; hash_probe_stats_read()
+ * sums them. A thread claims a slot from a registry on its first lookup
+ * and gives it back when it exits, and the next new thread carries on
+ * counting in it, so no counts are lost and the registry only grows to
+ * the largest number of threads alive at once.
+ */
+struct hash_probe_stats
+{
+	unsigned long lookups;
+	unsigned long probes;
+};
+
+#ifdef HASHTABLE_STATS
+#define HASH_PROBE_ALIGN	64
+
+struct __hash_probe_slot
+{
+	struct hash_probe_stats st;
+	struct __hash_probe_slot *next;
+	bool owned;
+} __attribute__((aligned(HASH_PROBE_ALIGN)));
+
+struct __hash_probe_registry
+{
+	pthread_mutex_t lock;
+	pthread_once_t once;
+	pthread_key_t key;		/* releases a slot on thread exit */
+	struct __hash_probe_slot *slots;
+	struct __hash_probe_slot spare;	/* shared if a slot can't be allocated */
+	struct hash_probe_stats base;	/* totals at the last reset */
+};
+
+/* weak, like rcu_state, so every translation unit shares one registry */
+struct __hash_probe_registry __hash_probe_registry __attribute__((weak)) = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.once = PTHREAD_ONCE_INIT,
+};
+
+__thread struct hash_probe_stats *__hash_probe_self __attribute__((weak));
+
+static inline void __hash_probe_release(void *arg)
+{
+	struct __hash_probe_slot *slot = (struct __hash_probe_slot *)arg;
+
+	pthread_mutex_lock(&__hash_probe_registry.lock);
+	slot->owned = false;
+	pthread_mutex_unlock(&__hash_probe_registry.lock);
+}
+
+static inline void __hash_probe_key_init(void)
+{
+	pthread_key_create(&__hash_probe_registry.key, __hash_probe_release);
+}
+
+static inline __attribute__((cold)) struct hash_probe_stats *
+__hash_probe_claim(void)
+{
+	struct __hash_probe_registry *r = &__hash_probe_registry;
+	struct __hash_probe_slot *slot;
+
+	pthread_once(&r->once, __hash_probe_key_init);
+	pthread_mutex_lock(&r->lock);
+	for (slot = r->slots; slot && slot->owned; slot = slot->next)
+		;
+	if (!slot) {
+		slot = (struct __hash_probe_slot *)aligned_alloc(HASH_PROBE_ALIGN,
+						sizeof(*slot));
+		if (slot) {
+			memset(slot, 0, sizeof(*slot));
+			slot->next = r->slots;
+			r->slots = slot;
+		}
+	}
+	if (slot) {
+		slot->owned = true;
+		pthread_setspecific(r->key, slot);
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	/* without a slot of its own, count racily in the shared one */
+	return __hash_probe_self = slot ? &slot->st : &r->spare.st;
+}
+
+/* only the owner writes a slot; the atomic store keeps readers tear-free */
+static inline void __hash_count_inc(unsigned long *c)
+{
+	__atomic_store_n(c, *c + 1, __ATOMIC_RELAXED);
+}
+
+#define __hash_count(field)						\
+	__hash_count_inc(&(__builtin_expect(__hash_probe_self != NULL, 1) ?\
+			   __hash_probe_self : __hash_probe_claim())->field)
+
+#define hlist_for_each_entry_probe(pos, head, member)			\
+	for (__hash_count(lookups),					\
+	     pos = hlist_entry_safe((head)->first, typeof(*(pos)), member);\
+	     pos && (__hash_count(probes), 1);				\
+	     pos = hlist_entry_safe((pos)->member.next, typeof(*(pos)), member))
+
+#define hlist_for_each_entry_safe_probe(pos, n, head, member)		\
+	for (__hash_count(lookups),					\
+	     pos = hlist_entry_safe((head)->first, typeof(*pos), member);\
+	     pos && ({ n = pos->member.next; __hash_count(probes); 1; });\
+	     pos = hlist_entry_safe(n, typeof(*pos), member))
+
+#define hlist_for_each_entry_rcu_probe(pos, head, member)		\
+	for (__hash_count(lookups),					\
+	     pos = hlist_entry_safe(rcu_dereference(hlist_first_rcu(head)),\
+			typeof(*(pos)), member);				\
+	     pos && (__hash_count(probes), 1);				\
+	     pos = hlist_entry_safe(rcu_dereference(hlist_next_rcu(		\
+			&(pos)->member)), typeof(*(pos)), member))
+
+static inline void __hash_probe_sum(struct hash_probe_stats *st)
+{
+	struct __hash_probe_registry *r = &__hash_probe_registry;
+	struct __hash_probe_slot *slot;
+
+	st->lookups = __atomic_load_n(&r->spare.st.lookups, __ATOMIC_RELAXED);
+	st->probes = __atomic_load_n(&r->spare.st.probes, __ATOMIC_RELAXED);
+	for (slot = r->slots; slot; slot = slot->next) {
+		st->lookups += __atomic_load_n(&slot->st.lookups, __ATOMIC_RELAXED);
+		st->probes += __atomic_load_n(&slot->st.probes, __ATOMIC_RELAXED);
+	}
+}
+#else
+#define hlist_for_each_entry_probe	hlist_for_each_entry
+#define hlist_for_each_entry_safe_probe	hlist_for_each_entry_safe
+#define hlist_for_each_entry_rcu_probe	hlist_for_each_entry_rcu
+#endif
+
+/**
+ * hash_probe_stats_read - snapshot the lookup probe counters
+ * @st: receives the counters, all zero without HASHTABLE_STATS
+ *
+ * Sums every thread's counters. Lookups running meanwhile may or may not
+ * be included.
+ */
+static inline void hash_probe_stats_read(struct hash_probe_stats *st)
+{
+#ifdef HASHTABLE_STATS
+	struct __hash_probe_registry *r = &__hash_probe_registry;
+
+	pthread_mutex_lock(&r->lock);
+	__hash_probe_sum(st);
+	st->lookups -= r->base.lookups;
+	st->probes -= r->base.probes;
+	pthread_mutex_unlock(&r->lock);
+#else
+	st->lookups = st->probes = 0;
+#endif
+}
+
+/*
+ * Counting restarts from zero. Slots are only written by their threads,
+ * so the totals at this point are remembered and subtracted by later reads.
+ */
+static inline void hash_probe_stats_reset(void)
+{
+#ifdef HASHTABLE_STATS
+	struct __hash_probe_registry *r = &__hash_probe_registry;
+
+	pthread_mutex_lock(&r->lock);
+	__hash_probe_sum(&r->base);
+	pthread_mutex_unlock(&r->lock);
+#endif
+}
+
 /*
  * Statically sized hash table implementation
  */
@@ -181,7 +492,9 @@ static inline void hlist_move_list(struct hlist_head *old,
 	struct hlist_head name[1 << (bits)]
 
 #define HASH_SIZE(name) (ARRAY_SIZE(name))
-#define HASH_BITS(name) (int)log2(HASH_SIZE(name)*1.) /* log2 appears in C99 */
+/* HASH_SIZE() is a power of two: its log2 is the index of its only set bit */
+#define HASH_BITS(name)							\
+	(int)(63 - __builtin_clzll((unsigned long long)HASH_SIZE(name)))
 
 /* Use hash_32 when possible to allow for fast 32bit hashing in 64bit kernels. */
 #define hash_min(val, bits)							\
@@ -319,7 +632,7 @@ static inline void hash_del_rcu(struct hlist_node *node)
  * @key: the key of the objects to iterate over
  */
 #define hash_for_each_possible(name, obj, member, key)			\
-	hlist_for_each_entry(obj, &name[hash_min(key, HASH_BITS(name))], member)
+	hlist_for_each_entry_probe(obj, &name[hash_min(key, HASH_BITS(name))], member)
 
 /**
  * hash_for_each_possible_rcu - iterate over all possible objects hashing to the
@@ -331,7 +644,7 @@ static inline void hash_del_rcu(struct hlist_node *node)
  * @key: the key of the objects to iterate over
  */
 #define hash_for_each_possible_rcu(name, obj, member, key)		\
-	hlist_for_each_entry_rcu(obj, &name[hash_min(key, HASH_BITS(name))],\
+	hlist_for_each_entry_rcu_probe(obj, &name[hash_min(key, HASH_BITS(name))],\
 		member)
 
 /**
@@ -344,7 +657,549 @@ static inline void hash_del_rcu(struct hlist_node *node)
  * @key: the key of the objects to iterate over
  */
 #define hash_for_each_possible_safe(name, obj, tmp, member, key)	\
-	hlist_for_each_entry_safe(obj, tmp,\
+	hlist_for_each_entry_safe_probe(obj, tmp,\
 		&name[hash_min(key, HASH_BITS(name))], member)
 
+/*
+ * Variable-length keys. These take a pointer and a length instead of an
+ * integer key and bucket with hash_bytes(); hash_del() and the full-table
+ * iterators work unchanged on such tables.
+ */
+
+/**
+ * hash_add_bytes - add an object keyed by a byte string to a hashtable
+ * @hashtable: hashtable to add to
+ * @node: the &struct hlist_node of the object to be added
+ * @key: pointer to the key bytes
+ * @len: length of the key in bytes
+ */
+#define hash_add_bytes(hashtable, node, key, len)			\
+	hlist_add_head(node,						\
+		&hashtable[hash_bytes_bits(key, len, HASH_BITS(hashtable))])
+
+/**
+ * hash_add_bytes_rcu - add an object keyed by a byte string to a rcu
+ * enabled hashtable
+ * @hashtable: hashtable to add to
+ * @node: the &struct hlist_node of the object to be added
+ * @key: pointer to the key bytes
+ * @len: length of the key in bytes
+ */
+#define hash_add_bytes_rcu(hashtable, node, key, len)			\
+	hlist_add_head_rcu(node,					\
+		&hashtable[hash_bytes_bits(key, len, HASH_BITS(hashtable))])
+
+/**
+ * hash_for_each_possible_bytes - iterate over all possible objects whose
+ * byte-string key hashes to the same bucket
+ * @name: hashtable to iterate
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ * @key: pointer to the key bytes
+ * @len: length of the key in bytes
+ */
+#define hash_for_each_possible_bytes(name, obj, member, key, len)	\
+	hlist_for_each_entry_probe(obj,					\
+		&name[hash_bytes_bits(key, len, HASH_BITS(name))], member)
+
+/**
+ * hash_for_each_possible_bytes_rcu - iterate over all possible objects whose
+ * byte-string key hashes to the same bucket in an rcu enabled hashtable
+ * @name: hashtable to iterate
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ * @key: pointer to the key bytes
+ * @len: length of the key in bytes
+ */
+#define hash_for_each_possible_bytes_rcu(name, obj, member, key, len)	\
+	hlist_for_each_entry_rcu_probe(obj,					\
+		&name[hash_bytes_bits(key, len, HASH_BITS(name))], member)
+
+/*
+ * Keyed tables for untrusted keys. DEFINE_KEYED_HASHTABLE() declares the
+ * bucket array together with a per-table SipHash key, name##_seed, that
+ * hash_init_keyed() draws at random. Buckets are picked with hash_keyed()
+ * instead of hash_min(), so an attacker who doesn't know the seed can't
+ * aim keys at one bucket. hash_del() and the full-table iterators work
+ * unchanged on such tables.
+ */
+#define DEFINE_KEYED_HASHTABLE(name, bits)				\
+	DEFINE_HASHTABLE(name, bits);					\
+	struct siphash_key name##_seed
+
+#define DECLARE_KEYED_HASHTABLE(name, bits)				\
+	DECLARE_HASHTABLE(name, bits);					\
+	struct siphash_key name##_seed
+
+/**
+ * hash_init_keyed - initialize a keyed hashtable and draw its seed
+ * @hashtable: hashtable declared with DEFINE/DECLARE_KEYED_HASHTABLE()
+ */
+#define hash_init_keyed(hashtable)					\
+	do {								\
+		hash_init(hashtable);					\
+		siphash_key_init(&hashtable##_seed);			\
+	} while (0)
+
+/**
+ * hash_add_keyed - add an object to a keyed hashtable
+ * @hashtable: hashtable to add to
+ * @node: the &struct hlist_node of the object to be added
+ * @key: the key of the object to be added
+ */
+#define hash_add_keyed(hashtable, node, key)				\
+	hlist_add_head(node, &hashtable[hash_keyed(key,			\
+			HASH_BITS(hashtable), &hashtable##_seed)])
+
+/**
+ * hash_for_each_possible_keyed - iterate over all possible objects hashing
+ * to the same bucket of a keyed hashtable
+ * @name: hashtable to iterate
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ * @key: the key of the objects to iterate over
+ */
+#define hash_for_each_possible_keyed(name, obj, member, key)		\
+	hlist_for_each_entry_probe(obj,					\
+		&name[hash_keyed(key, HASH_BITS(name), &name##_seed)], member)
+
+/**
+ * hash_for_each_possible_keyed_safe - iterate over all possible objects
+ * hashing to the same bucket of a keyed hashtable safe against removals
+ * @name: hashtable to iterate
+ * @obj: the type * to use as a loop cursor for each entry
+ * @tmp: a &struct used for temporary storage
+ * @member: the name of the hlist_node within the struct
+ * @key: the key of the objects to iterate over
+ */
+#define hash_for_each_possible_keyed_safe(name, obj, tmp, member, key)	\
+	hlist_for_each_entry_safe_probe(obj, tmp,			\
+		&name[hash_keyed(key, HASH_BITS(name), &name##_seed)], member)
+
+/*
+ * Batched lookup.
+ *
+ * Looking keys up one at a time through hash_for_each_possible() stalls on
+ * the bucket head miss and then on every chain node miss in turn. The batch
+ * version works on groups of HASH_BATCH_GROUP keys in stages: compute all
+ * bucket indexes and prefetch the heads, then load the heads and prefetch
+ * the first nodes, then walk all chains in lock step, one node per key per
+ * round, prefetching the next node of every chain that hasn't matched yet.
+ * The misses of a whole group overlap instead of queuing behind each other.
+ */
+#define HASH_BATCH_GROUP	16
+
+/**
+ * hash_lookup_batch - look up many keys in a hashtable at once
+ * @name: hashtable to search
+ * @keys: array of @n keys
+ * @n: number of keys
+ * @out: array of @n type * receiving the first object whose @keyfield
+ *	equals the key, or NULL
+ * @member: the name of the hlist_node within the struct
+ * @keyfield: the name of the key within the struct
+ */
+#define hash_lookup_batch(name, keys, n, out, member, keyfield)		\
+do {									\
+	struct hlist_node *__pos[HASH_BATCH_GROUP];			\
+	unsigned int __bkt[HASH_BATCH_GROUP];				\
+	size_t __g, __i, __cnt, __left;					\
+									\
+	for (__g = 0; __g < (size_t)(n); __g += HASH_BATCH_GROUP) {	\
+		__cnt = (size_t)(n) - __g;				\
+		if (__cnt > HASH_BATCH_GROUP)				\
+			__cnt = HASH_BATCH_GROUP;			\
+									\
+		for (__i = 0; __i < __cnt; __i++) {			\
+			__bkt[__i] = hash_min((keys)[__g + __i],	\
+					      HASH_BITS(name));		\
+			__builtin_prefetch(&(name)[__bkt[__i]]);	\
+		}							\
+									\
+		for (__i = 0; __i < __cnt; __i++) {			\
+			__pos[__i] = (name)[__bkt[__i]].first;		\
+			(out)[__g + __i] = NULL;			\
+			if (__pos[__i])					\
+				__builtin_prefetch(&hlist_entry(__pos[__i],\
+					typeof(**(out)), member)->keyfield);\
+		}							\
+									\
+		for (__left = __cnt; __left; ) {			\
+			__left = 0;					\
+			for (__i = 0; __i < __cnt; __i++) {		\
+				typeof(*(out)) __obj;			\
+									\
+				if (!__pos[__i])			\
+					continue;			\
+				__obj = hlist_entry(__pos[__i],		\
+					typeof(**(out)), member);	\
+				if (__obj->keyfield == (keys)[__g + __i]) {\
+					(out)[__g + __i] = __obj;	\
+					__pos[__i] = NULL;		\
+					continue;			\
+				}					\
+				__pos[__i] = __pos[__i]->next;		\
+				if (__pos[__i]) {			\
+					__builtin_prefetch(&hlist_entry(\
+						__pos[__i], typeof(**(out)),\
+						member)->keyfield);	\
+					__left++;			\
+				}					\
+			}						\
+		}							\
+	}								\
+} while (0)
+
+/*
+ * Occupancy bitmap for sparse tables.
+ *
+ * hash_empty() and hash_for_each() look at every bucket, which dominates
+ * periodic scans of big tables holding few entries. DEFINE_SPARSE_HASHTABLE()
+ * adds a bitmap, name##_occ, with one bit per non-empty bucket, kept up to
+ * date by hash_add_sparse() and hash_del_sparse(). Iteration jumps between
+ * set bits with a count-trailing-zeros per word and the emptiness check
+ * reads buckets / BITS_PER_LONG words. Lookups use hash_for_each_possible()
+ * as usual.
+ *
+ * ONLY ADD ENTRIES WITH hash_add_sparse(). These are ordinary bucket
+ * arrays, so hash_add() and hash_add_rcu() still compile on them, but an
+ * entry they add sits in a bucket whose bit may be clear, and
+ * hash_for_each_sparse() and hash_empty_sparse() will not see it. Deletes
+ * should go through hash_del_sparse() as well. hash_del() and
+ * hash_del_rcu() only take the node and can't be told apart, so a bit they
+ * leave set on an emptied bucket is tolerated: iteration finds nothing
+ * there, and hash_empty_sparse() checks every set bit against its bucket
+ * and clears the stale ones.
+ */
+#define BITS_TO_LONGS(nr)	(((nr) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+#define DEFINE_SPARSE_HASHTABLE(name, bits)				\
+	DEFINE_HASHTABLE(name, bits);					\
+	unsigned long name##_occ[BITS_TO_LONGS(1 << (bits))]
+
+#define DECLARE_SPARSE_HASHTABLE(name, bits)				\
+	DECLARE_HASHTABLE(name, bits);					\
+	unsigned long name##_occ[BITS_TO_LONGS(1 << (bits))]
+
+/* first occupied bucket >= @from, or @sz */
+static inline unsigned int __hash_occ_next(const unsigned long *occ,
+					   unsigned int sz, unsigned int from)
+{
+	unsigned int w;
+	unsigned long word;
+
+	if (from >= sz)
+		return sz;
+
+	w = from / BITS_PER_LONG;
+	word = occ[w] & (~0UL << (from % BITS_PER_LONG));
+	while (!word) {
+		if (++w >= BITS_TO_LONGS(sz))
+			return sz;
+		word = occ[w];
+	}
+
+	return w * BITS_PER_LONG + __builtin_ctzl(word);
+}
+
+/* set bits whose bucket is empty were left by hash_del() and are cleared */
+static inline bool __hash_occ_empty(const struct hlist_head *ht,
+				    unsigned long *occ, unsigned int sz)
+{
+	unsigned int w, bkt;
+	unsigned long word;
+
+	for (w = 0; w < BITS_TO_LONGS(sz); w++) {
+		for (word = occ[w]; word; word &= word - 1) {
+			bkt = w * BITS_PER_LONG + __builtin_ctzl(word);
+			if (!hlist_empty(&ht[bkt]))
+				return false;
+			occ[w] &= ~(1UL << (bkt % BITS_PER_LONG));
+		}
+	}
+
+	return true;
+}
+
+static inline void __hash_add_sparse(struct hlist_head *ht,
+				     unsigned long *occ, unsigned int bkt,
+				     struct hlist_node *node)
+{
+	hlist_add_head(node, &ht[bkt]);
+	occ[bkt / BITS_PER_LONG] |= 1UL << (bkt % BITS_PER_LONG);
+}
+
+/*
+ * The bucket only becomes empty when its sole entry goes, and that entry's
+ * pprev points at the head inside the array, which gives the bucket index
+ * without needing the key.
+ */
+static inline void __hash_del_sparse(struct hlist_head *ht,
+				     unsigned long *occ, unsigned int sz,
+				     struct hlist_node *node)
+{
+	uintptr_t head = (uintptr_t)node->pprev;
+	unsigned int bkt;
+
+	if (hlist_unhashed(node))
+		return;
+
+	if (!node->next && head >= (uintptr_t)ht &&
+	    head < (uintptr_t)(ht + sz)) {
+		bkt = (struct hlist_head *)head - ht;
+		occ[bkt / BITS_PER_LONG] &= ~(1UL << (bkt % BITS_PER_LONG));
+	}
+
+	hlist_del_init(node);
+}
+
+/**
+ * hash_init_sparse - initialize a sparse hashtable and its bitmap
+ * @hashtable: hashtable declared with DEFINE/DECLARE_SPARSE_HASHTABLE()
+ */
+#define hash_init_sparse(hashtable)					\
+	do {								\
+		hash_init(hashtable);					\
+		memset(hashtable##_occ, 0, sizeof(hashtable##_occ));	\
+	} while (0)
+
+/**
+ * hash_add_sparse - add an object to a sparse hashtable
+ * @hashtable: hashtable to add to
+ * @node: the &struct hlist_node of the object to be added
+ * @key: the key of the object to be added
+ */
+#define hash_add_sparse(hashtable, node, key)				\
+	__hash_add_sparse(hashtable, hashtable##_occ,			\
+			  hash_min(key, HASH_BITS(hashtable)), node)
+
+/**
+ * hash_del_sparse - remove an object from a sparse hashtable
+ * @hashtable: hashtable to remove from
+ * @node: &struct hlist_node of the object to remove
+ */
+#define hash_del_sparse(hashtable, node)				\
+	__hash_del_sparse(hashtable, hashtable##_occ,			\
+			  HASH_SIZE(hashtable), node)
+
+/**
+ * hash_empty_sparse - check whether a sparse hashtable is empty
+ * @hashtable: hashtable to check
+ */
+#define hash_empty_sparse(hashtable)					\
+	__hash_occ_empty(hashtable, hashtable##_occ, HASH_SIZE(hashtable))
+
+/**
+ * hash_for_each_sparse - iterate over the occupied buckets of a sparse
+ * hashtable
+ * @name: hashtable to iterate
+ * @bkt: integer to use as bucket loop cursor
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ */
+#define hash_for_each_sparse(name, bkt, obj, member)			\
+	for ((bkt) = __hash_occ_next(name##_occ, HASH_SIZE(name), 0),	\
+	     obj = NULL;						\
+	     obj == NULL && (bkt) < HASH_SIZE(name);			\
+	     (bkt) = __hash_occ_next(name##_occ, HASH_SIZE(name), (bkt) + 1))\
+		hlist_for_each_entry(obj, &name[bkt], member)
+
+/**
+ * hash_for_each_sparse_safe - iterate over the occupied buckets of a sparse
+ * hashtable safe against removal of hash entry
+ * @name: hashtable to iterate
+ * @bkt: integer to use as bucket loop cursor
+ * @tmp: a &struct used for temporary storage
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ *
+ * Remove entries with hash_del_sparse().
+ */
+#define hash_for_each_sparse_safe(name, bkt, tmp, obj, member)		\
+	for ((bkt) = __hash_occ_next(name##_occ, HASH_SIZE(name), 0),	\
+	     obj = NULL;						\
+	     obj == NULL && (bkt) < HASH_SIZE(name);			\
+	     (bkt) = __hash_occ_next(name##_occ, HASH_SIZE(name), (bkt) + 1))\
+		hlist_for_each_entry_safe(obj, tmp, &name[bkt], member)
+
+/*
+ * Table statistics.
+ *
+ * One pass over the buckets and chains, so O(buckets + entries) and no
+ * per-operation cost: cheap enough to run from a periodic reporter, not
+ * from a hot path.
+ */
+#define HASH_STATS_HIST		16	/* chains >= 15 share the last slot */
+
+struct hash_stats
+{
+	unsigned long buckets;
+	unsigned long entries;
+	unsigned long empty;		/* buckets with no entry */
+	unsigned long max_chain;
+	double load_factor;		/* entries / buckets */
+	double mean_chain;		/* entries / non-empty buckets */
+	double empty_ratio;		/* empty / buckets */
+	unsigned long hist[HASH_STATS_HIST];	/* buckets by chain length */
+	struct hash_probe_stats probes;	/* zero without HASHTABLE_STATS */
+};
+
+static inline void __hash_stats(struct hlist_head *ht, unsigned int sz,
+				struct hash_stats *st)
+{
+	struct hlist_node *pos;
+	unsigned long len;
+	unsigned int i;
+
+	memset(st, 0, sizeof(*st));
+	st->buckets = sz;
+
+	for (i = 0; i < sz; i++) {
+		len = 0;
+		hlist_for_each(pos, &ht[i])
+			len++;
+
+		st->entries += len;
+		if (len > st->max_chain)
+			st->max_chain = len;
+		st->hist[len < HASH_STATS_HIST ? len : HASH_STATS_HIST - 1]++;
+	}
+
+	st->empty = st->hist[0];
+	st->load_factor = (double)st->entries / sz;
+	st->mean_chain = st->empty < sz ?
+		(double)st->entries / (sz - st->empty) : 0;
+	st->empty_ratio = (double)st->empty / sz;
+	hash_probe_stats_read(&st->probes);
+}
+
+/**
+ * hash_stats - collect occupancy statistics of a hashtable
+ * @hashtable: hashtable to inspect
+ * @st: &struct hash_stats to fill in
+ */
+#define hash_stats(hashtable, st) __hash_stats(hashtable, HASH_SIZE(hashtable), st)
+
+/*
+ * Cached hashes. struct hlist_hnode is an hlist_node followed by the full
+ * hash of its object's key and chains into ordinary DEFINE_HASHTABLE()
+ * tables. The lookup macros compare the cached hash, which shares a cache
+ * line with the ->next pointer the walk reads anyway, and only hand nodes
+ * whose hash matches to the loop body, so the key itself (a string, a
+ * composite) is only dereferenced for likely hits. Moving entries into a
+ * table of another size reuses the cached hash instead of rehashing keys.
+ *
+ * Any 32- or 64-bit hash works, e.g. hash_bytes() of a string key; the
+ * bucket is taken from hash_64() of it.
+ */
+struct hlist_hnode
+{
+	struct hlist_node node;
+	uint64_t hash;
+};
+
+/**
+ * hlist_hnode_hash - cached hash of the hlist_hnode around @node
+ * @node: the &struct hlist_node inside a &struct hlist_hnode
+ *
+ * Matches rhash_hashfn_t, so rhashtable.h tables of hnodes resize
+ * without touching their keys.
+ */
+static inline uint64_t hlist_hnode_hash(const struct hlist_node *node)
+{
+	return container_of(node, struct hlist_hnode, node)->hash;
+}
+
+static inline void __hash_add_hashed(struct hlist_head *ht, unsigned int bits,
+				     struct hlist_hnode *hnode, uint64_t hash)
+{
+	hnode->hash = hash;
+	hlist_add_head(&hnode->node, &ht[hash_64(hash, bits)]);
+}
+
+static inline void __hash_add_hashed_rcu(struct hlist_head *ht,
+					 unsigned int bits,
+					 struct hlist_hnode *hnode,
+					 uint64_t hash)
+{
+	hnode->hash = hash;
+	hlist_add_head_rcu(&hnode->node, &ht[hash_64(hash, bits)]);
+}
+
+/**
+ * hash_add_hashed - add an object to a hashtable, caching its hash
+ * @hashtable: hashtable to add to
+ * @hnode: the &struct hlist_hnode of the object to be added
+ * @hash: the full hash of the object's key
+ */
+#define hash_add_hashed(hashtable, hnode, hash)				\
+	__hash_add_hashed(hashtable, HASH_BITS(hashtable), hnode, hash)
+
+/**
+ * hash_add_hashed_rcu - add an object to a rcu enabled hashtable, caching
+ * its hash
+ * @hashtable: hashtable to add to
+ * @hnode: the &struct hlist_hnode of the object to be added
+ * @hash: the full hash of the object's key
+ */
+#define hash_add_hashed_rcu(hashtable, hnode, hash)			\
+	__hash_add_hashed_rcu(hashtable, HASH_BITS(hashtable), hnode, hash)
+
+/**
+ * hash_for_each_possible_hashed - iterate over the objects of a bucket whose
+ * cached hash equals @hash
+ * @name: hashtable to iterate
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_hnode within the struct
+ * @hash: the full hash of the key to look up
+ *
+ * The body still has to compare keys, but only for hash matches.
+ */
+#define hash_for_each_possible_hashed(name, obj, member, hash)		\
+	for (uint64_t __h = (hash), __o = 1; __o; __o = 0)		\
+		hlist_for_each_entry_probe(obj,				\
+			&name[hash_64(__h, HASH_BITS(name))], member.node)\
+			if ((obj)->member.hash != __h) {} else
+
+/**
+ * hash_for_each_possible_hashed_rcu - iterate over the objects of a bucket
+ * whose cached hash equals @hash in a rcu enabled hashtable
+ * @name: hashtable to iterate
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_hnode within the struct
+ * @hash: the full hash of the key to look up
+ */
+#define hash_for_each_possible_hashed_rcu(name, obj, member, hash)	\
+	for (uint64_t __h = (hash), __o = 1; __o; __o = 0)		\
+		hlist_for_each_entry_rcu_probe(obj,			\
+			&name[hash_64(__h, HASH_BITS(name))], member.node)\
+			if ((obj)->member.hash != __h) {} else
+
+static inline void __hash_move_hashed(struct hlist_head *from,
+				      unsigned int from_sz,
+				      struct hlist_head *to,
+				      unsigned int to_bits)
+{
+	struct hlist_node *pos, *n;
+	unsigned int i;
+
+	for (i = 0; i < from_sz; i++) {
+		hlist_for_each_safe(pos, n, &from[i]) {
+			hlist_del(pos);
+			hlist_add_head(pos, &to[hash_64(hlist_hnode_hash(pos),
+							to_bits)]);
+		}
+	}
+}
+
+/**
+ * hash_move_hashed - move every hnode of one hashtable into another
+ * @from: hashtable to empty, all of its nodes must be hlist_hnodes
+ * @to: hashtable to fill, usually of a different size
+ *
+ * Buckets come from the cached hashes; no key is looked at.
+ */
+#define hash_move_hashed(from, to)					\
+	__hash_move_hashed(from, HASH_SIZE(from), to, HASH_BITS(to))
+
 #endif /* end of __HASHTABLE_H__ */
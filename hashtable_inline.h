@@ -0,0 +1,208 @@
+#ifndef __HASHTABLE_INLINE_H__
+#define __HASHTABLE_INLINE_H__
+
+#include "hashtable.h"
+
+/*
+ * Hashtables with inline-first-entry buckets.
+ *
+ * A DEFINE_HASHTABLE() bucket is a single pointer, so every lookup loads
+ * the head and then the first node before it learns anything, and a miss
+ * walks the whole chain. Here a bucket holds the first HASH_INLINE_SLOTS
+ * entries as node pointers tagged with a 16-bit fingerprint of their key,
+ * plus an ordinary hlist for overflow. A lookup compares the fingerprints
+ * in the bucket and only follows pointers whose fingerprint matches: a hit
+ * costs the bucket and the object it returns, a miss usually just the
+ * bucket.
+ *
+ * The fingerprint lives in the top 16 bits of the slot pointer, which user
+ * space addresses leave clear on 64-bit targets (a node that doesn't fit
+ * goes to the overflow list), so a bucket is (HASH_INLINE_SLOTS + 1)
+ * pointers: 16 bytes by default, 32 or 64 with 3 or 7 slots. Buckets are
+ * aligned to their size and never straddle a cache line.
+ *
+ * Objects embed a plain &struct hlist_node. An inline entry's pprev points
+ * at its slot and its next is NULL, so hash_del() clears slot and tag
+ * together, and hash_del() and hash_hashed() work on both kinds of entries
+ * unchanged. A freed slot is reused by the next insert into the bucket;
+ * overflow entries stay where they are.
+ *
+ * A bucket is still twice a DEFINE_HASHTABLE() head. A hit costs two
+ * misses either way (bucket, then object), so with one slot hits match a
+ * chained table from about half an entry per bucket on and misses get
+ * cheaper; in sparser tables, where most chained lookups stop at a NULL
+ * head, the larger array makes both slower. Extra slots only pay off with
+ * chains of about three entries.
+ */
+
+#ifndef HASH_INLINE_SLOTS
+#define HASH_INLINE_SLOTS	1
+#endif
+
+#if UINTPTR_MAX != UINT64_MAX
+#error "hashtable_inline.h tags pointers and needs a 64-bit target"
+#endif
+
+_Static_assert(HASH_INLINE_SLOTS == 1 || HASH_INLINE_SLOTS == 3 ||
+	       HASH_INLINE_SLOTS == 7, "HASH_INLINE_SLOTS must be 1, 3 or 7");
+
+#define HASH_INLINE_FP_SHIFT	48
+#define HASH_INLINE_PTR_MASK	((1ULL << HASH_INLINE_FP_SHIFT) - 1)
+
+struct hash_ibucket
+{
+	struct hlist_node *slot[HASH_INLINE_SLOTS];	/* fingerprint-tagged */
+	struct hlist_head overflow;
+} __attribute__((aligned((HASH_INLINE_SLOTS + 1) * sizeof(void *))));
+
+#define DEFINE_INLINE_HASHTABLE(name, bits)				\
+	struct hash_ibucket name[1 << (bits)]
+
+#define DECLARE_INLINE_HASHTABLE(name, bits)				\
+	struct hash_ibucket name[1 << (bits)]
+
+/* bucket from the top bits of the hash, fingerprint from the 16 below */
+static inline uint64_t __hash_inline_hash(uint64_t key)
+{
+	return hash_64(key, 64);
+}
+
+static inline uint16_t __hash_inline_fp(uint64_t hash, unsigned int bits)
+{
+	return (uint16_t)(hash >> (48 - bits));
+}
+
+/**
+ * hash_init_inline - initialize a hashtable with inline buckets
+ * @hashtable: hashtable to be initialized
+ */
+#define hash_init_inline(hashtable)					\
+	memset(hashtable, 0, sizeof(hashtable))
+
+static inline void __hash_add_inline(struct hash_ibucket *ht,
+				     unsigned int bits,
+				     struct hlist_node *node, uint64_t key)
+{
+	uint64_t hash = __hash_inline_hash(key);
+	struct hash_ibucket *b = &ht[hash >> (64 - bits)];
+	unsigned int i;
+
+	for (i = 0; i < HASH_INLINE_SLOTS; i++) {
+		if (!b->slot[i] && !((uintptr_t)node & ~HASH_INLINE_PTR_MASK)) {
+			node->next = NULL;
+			node->pprev = &b->slot[i];
+			b->slot[i] = (struct hlist_node *)((uintptr_t)node |
+				((uintptr_t)__hash_inline_fp(hash, bits) <<
+				 HASH_INLINE_FP_SHIFT));
+			return;
+		}
+	}
+
+	hlist_add_head(node, &b->overflow);
+}
+
+/**
+ * hash_add_inline - add an object to a hashtable with inline buckets
+ * @hashtable: hashtable to add to
+ * @node: the &struct hlist_node of the object to be added
+ * @key: the key of the object to be added
+ *
+ * Remove objects with hash_del().
+ */
+#define hash_add_inline(hashtable, node, key)				\
+	__hash_add_inline(hashtable, HASH_BITS(hashtable), node, key)
+
+/*
+ * Cursor over the candidates of one bucket: the inline slots set in @mask,
+ * then the overflow chain.
+ */
+struct hash_inline_iter
+{
+	struct hash_ibucket *b;
+	struct hlist_node *pos;
+	unsigned int mask;
+	bool overflow;
+};
+
+/* slots whose fingerprint is @fp, found without touching any node */
+static inline unsigned int __hash_inline_match(const struct hash_ibucket *b,
+					       uint16_t fp)
+{
+	unsigned int i, mask = 0;
+
+	for (i = 0; i < HASH_INLINE_SLOTS; i++)
+		mask |= (unsigned int)((uintptr_t)b->slot[i] >>
+				       HASH_INLINE_FP_SHIFT == fp) << i;
+
+	return mask;
+}
+
+static inline struct hash_inline_iter
+__hash_inline_iter(struct hash_ibucket *ht, unsigned int bits, uint64_t key)
+{
+	uint64_t hash = __hash_inline_hash(key);
+	struct hash_inline_iter it = { .b = &ht[hash >> (64 - bits)] };
+
+	it.mask = __hash_inline_match(it.b, __hash_inline_fp(hash, bits));
+	return it;
+}
+
+static inline struct hlist_node *__hash_inline_next(struct hash_inline_iter *it)
+{
+	struct hlist_node *n;
+	unsigned int i;
+
+	while (it->mask) {
+		i = __builtin_ctz(it->mask);
+		it->mask &= it->mask - 1;
+		n = (struct hlist_node *)((uintptr_t)it->b->slot[i] &
+					  HASH_INLINE_PTR_MASK);
+		if (n)
+			return n;
+	}
+
+	if (!it->overflow) {
+		it->overflow = true;
+		it->pos = it->b->overflow.first;
+	} else if (it->pos) {
+		it->pos = it->pos->next;
+	}
+
+	return it->pos;
+}
+
+/**
+ * hash_for_each_possible_inline - iterate over all possible objects hashing
+ * to the same bucket of a hashtable with inline buckets
+ * @name: hashtable to iterate
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ * @key: the key of the objects to iterate over
+ *
+ * Inline entries whose fingerprint differs from @key's are skipped without
+ * being dereferenced. The body may delete the current entry only if it
+ * breaks out right after.
+ */
+#define hash_for_each_possible_inline(name, obj, member, key)		\
+	for (struct hash_inline_iter __it =				\
+		__hash_inline_iter(name, HASH_BITS(name), key);	\
+	     (obj = hlist_entry_safe(__hash_inline_next(&__it),		\
+				     typeof(*(obj)), member)); )
+
+/**
+ * hash_for_each_inline - iterate over a hashtable with inline buckets
+ * @name: hashtable to iterate
+ * @bkt: integer to use as bucket loop cursor
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ */
+#define hash_for_each_inline(name, bkt, obj, member)			\
+	for ((bkt) = 0, obj = NULL; obj == NULL && (bkt) < HASH_SIZE(name);\
+			(bkt)++)					\
+		for (struct hash_inline_iter __it = {			\
+			.b = &(name)[bkt],				\
+			.mask = (1U << HASH_INLINE_SLOTS) - 1 };	\
+		     (obj = hlist_entry_safe(__hash_inline_next(&__it),	\
+					     typeof(*(obj)), member)); )
+
+#endif /* __HASHTABLE_INLINE_H__ */
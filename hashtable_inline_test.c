@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hashtable_inline.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+/* 2^20 buckets: 8MB chained, 16MB or more inline, well past any L2 */
+#define TABLE_BITS 20
+
+/* one cache line per object, like a typical container, on both tables */
+struct item
+{
+    uint64_t key;
+    struct hlist_node node;
+    struct hlist_node inode;
+    char payload[24];
+} __attribute__((aligned(64)));
+
+DEFINE_HASHTABLE(table, TABLE_BITS);
+DEFINE_INLINE_HASHTABLE(itable, TABLE_BITS);
+DEFINE_INLINE_HASHTABLE(small, 2);
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+}
+
+static struct item *lookup(uint64_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible(table, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+static struct item *lookup_inline(uint64_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible_inline(itable, obj, inode, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+static struct item *lookup_small(uint64_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible_inline(small, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+void TEST_INLINE()
+{
+    struct item items[100], *obj;
+    unsigned int bkt;
+    bool ok = true;
+    int i, cnt = 0;
+
+    /* 100 entries in 4 buckets: 4 * HASH_INLINE_SLOTS inline, the rest overflow */
+    hash_init_inline(small);
+    for (i = 0; i < 100; i++) {
+        items[i].key = i;
+        hash_add_inline(small, &items[i].node, items[i].key);
+    }
+    for (i = 0; i < 100; i++)
+        if (lookup_small(i) != &items[i])
+            ok = false;
+
+    /* hash_del() unlinks inline and overflow entries alike */
+    for (i = 0; i < 100; i += 2)
+        hash_del(&items[i].node);
+    for (i = 0; i < 100; i++)
+        if (lookup_small(i) != ((i & 1) ? &items[i] : NULL))
+            ok = false;
+
+    /* the freed slots are taken again */
+    for (i = 0; i < 100; i += 2)
+        hash_add_inline(small, &items[i].node, items[i].key);
+    hash_for_each_inline(small, bkt, obj, node)
+        cnt++;
+    if (cnt != 100)
+        ok = false;
+    for (bkt = 0; bkt < HASH_SIZE(small); bkt++)
+        for (i = 0; i < HASH_INLINE_SLOTS; i++)
+            if (!small[bkt].slot[i])
+                ok = false;
+
+    printf("%-28s", "TEST_INLINE");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/*
+ * The same objects indexed by a chained table and an inline-bucket table
+ * of 2^TABLE_BITS buckets each, so only the buckets differ; hits look up
+ * stored keys in random order, misses look up keys that aren't there.
+ */
+void compare_inline(int n)
+{
+    struct item *items = (struct item *)aligned_alloc(64,
+                                                      sizeof(struct item) * n);
+    uint64_t *keys = (uint64_t *)malloc(sizeof(uint64_t) * n);
+    double th, tm, ih, im;
+    unsigned long found = 0;
+    int i;
+
+    hash_init(table);
+    hash_init_inline(itable);
+    for (i = 0; i < n; i++) {
+        items[i].key = rand64();
+        hash_add(table, &items[i].node, items[i].key);
+        hash_add_inline(itable, &items[i].inode, items[i].key);
+    }
+    for (i = 0; i < n; i++)
+        keys[i] = items[rand() % n].key;
+
+    th = now();
+    for (i = 0; i < n; i++)
+        found += lookup(keys[i]) != NULL;
+    th = now() - th;
+    ih = now();
+    for (i = 0; i < n; i++)
+        found += lookup_inline(keys[i]) != NULL;
+    ih = now() - ih;
+
+    for (i = 0; i < n; i++)
+        keys[i] = rand64();
+    tm = now();
+    for (i = 0; i < n; i++)
+        found += lookup(keys[i]) != NULL;
+    tm = now() - tm;
+    im = now();
+    for (i = 0; i < n; i++)
+        found += lookup_inline(keys[i]) != NULL;
+    im = now() - im;
+
+    printf("%-10s%-10s%-8s%-14s%-14s%-14s%-14s\n", "Objects", "Load",
+           "Bucket", "Hit(ns)", "Inline hit", "Miss(ns)", "Inline miss");
+    printf("%-10d%-10.2f%-8zu%-14.1f%-14.1f%-14.1f%-14.1f\n", n,
+           (double)n / HASH_SIZE(table), sizeof(struct hash_ibucket),
+           th * 1e9 / n, ih * 1e9 / n, tm * 1e9 / n, im * 1e9 / n);
+    if (found != 2UL * n)
+        printf(KRED "%lu of %d hits found\n" RESET, found, 2 * n);
+
+    free(keys);
+    free(items);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <nobjects>\n", argv[0]);
+        exit(1);
+    }
+
+    srand((unsigned)time(0));
+    TEST_INLINE();
+    compare_inline(atoi(argv[1]));
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+#ifndef __HASHTABLE_STRIPED_H__
+#define __HASHTABLE_STRIPED_H__
+
+#include "hashtable.h"
+#include "spinlock.h"
+
+/*
+ * Striped locking for DEFINE_HASHTABLE() tables.
+ *
+ * Instead of one lock around the whole table, a second, smaller array of
+ * spinlocks is declared next to it and bucket i is protected by stripe
+ * (i & (nr_stripes - 1)). Writers to different stripes never contend, and
+ * each stripe sits on its own cache line so they don't false-share either.
+ *
+ *	DEFINE_HASHTABLE(table, 16);
+ *	DEFINE_HASH_STRIPES(table_locks, 8);
+ *
+ *	hash_add_striped(table, table_locks, &obj->node, obj->key);
+ *	hash_for_each_possible_striped(table, table_locks, obj, node, key)
+ *		if (obj->key == key)
+ *			break;
+ *
+ * The iteration macros hold the stripe for the duration of the loop body
+ * and drop it however the loop is left, including break and return.
+ */
+
+#define HASH_STRIPE_ALIGN	64
+
+struct hash_stripe
+{
+	spinlock_t lock;
+} __attribute__((aligned(HASH_STRIPE_ALIGN)));
+
+#define DEFINE_HASH_STRIPES(name, bits)					\
+	struct hash_stripe name[1 << (bits)] =				\
+			{ [0 ... ((1 << (bits)) - 1)] = { SPINLOCK_INIT } }
+
+#define DECLARE_HASH_STRIPES(name, bits)				\
+	struct hash_stripe name[1 << (bits)]
+
+static inline void __hash_stripes_init(struct hash_stripe *stripes,
+				       unsigned int sz)
+{
+	unsigned int i;
+
+	for (i = 0; i < sz; i++)
+		spin_lock_init(&stripes[i].lock);
+}
+
+/**
+ * hash_stripes_init - initialize a stripe array
+ * @stripes: array declared with DECLARE_HASH_STRIPES()
+ */
+#define hash_stripes_init(stripes) __hash_stripes_init(stripes, ARRAY_SIZE(stripes))
+
+static inline spinlock_t *__hash_stripe(struct hash_stripe *stripes,
+					unsigned int nr_stripes,
+					unsigned int bkt)
+{
+	return &stripes[bkt & (nr_stripes - 1)].lock;
+}
+
+#define hash_stripe_lock(stripes, bkt)					\
+	spin_lock(__hash_stripe(stripes, ARRAY_SIZE(stripes), bkt))
+
+#define hash_stripe_unlock(stripes, bkt)				\
+	spin_unlock(__hash_stripe(stripes, ARRAY_SIZE(stripes), bkt))
+
+/*
+ * Scope guard used by the iteration macros: the stripe is released by the
+ * cleanup attribute when the guard goes out of scope.
+ */
+struct hash_stripe_guard
+{
+	spinlock_t *lock;
+	int once;
+};
+
+static inline struct hash_stripe_guard
+__hash_stripe_guard_acquire(struct hash_stripe *stripes,
+			    unsigned int nr_stripes, unsigned int bkt)
+{
+	struct hash_stripe_guard g = {
+		.lock = __hash_stripe(stripes, nr_stripes, bkt),
+		.once = 1,
+	};
+
+	spin_lock(g.lock);
+	return g;
+}
+
+static inline void __hash_stripe_guard_release(struct hash_stripe_guard *g)
+{
+	if (g->lock)
+		spin_unlock(g->lock);
+}
+
+#define __hash_stripe_guard(guard, stripes, bkt)			\
+	struct hash_stripe_guard guard					\
+		__attribute__((cleanup(__hash_stripe_guard_release))) =	\
+		__hash_stripe_guard_acquire(stripes, ARRAY_SIZE(stripes), bkt)
+
+/**
+ * hash_add_striped - add an object to a hashtable under its bucket's stripe
+ * @name: hashtable to add to
+ * @stripes: stripe array protecting @name
+ * @node: the &struct hlist_node of the object to be added
+ * @key: the key of the object to be added
+ */
+#define hash_add_striped(name, stripes, node, key)			\
+	do {								\
+		unsigned int __bkt = hash_min(key, HASH_BITS(name));	\
+		hash_stripe_lock(stripes, __bkt);			\
+		hlist_add_head(node, &name[__bkt]);			\
+		hash_stripe_unlock(stripes, __bkt);			\
+	} while (0)
+
+/**
+ * hash_del_striped - remove an object from a hashtable under its stripe
+ * @name: hashtable to remove from
+ * @stripes: stripe array protecting @name
+ * @node: &struct hlist_node of the object to remove
+ * @key: the key the object was added with, selects the stripe
+ */
+#define hash_del_striped(name, stripes, node, key)			\
+	do {								\
+		unsigned int __bkt = hash_min(key, HASH_BITS(name));	\
+		hash_stripe_lock(stripes, __bkt);			\
+		hlist_del_init(node);					\
+		hash_stripe_unlock(stripes, __bkt);			\
+	} while (0)
+
+/**
+ * hash_for_each_possible_striped - iterate over all possible objects hashing
+ * to the same bucket, holding the bucket's stripe
+ * @name: hashtable to iterate
+ * @stripes: stripe array protecting @name
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ * @key: the key of the objects to iterate over
+ *
+ * The body may unlink the current entry only if it breaks out right after.
+ */
+#define hash_for_each_possible_striped(name, stripes, obj, member, key)	\
+	for (unsigned int __bkt = hash_min(key, HASH_BITS(name)), __o = 1;	\
+	     __o; __o = 0)						\
+		for (__hash_stripe_guard(__guard, stripes, __bkt);	\
+		     __guard.once; __guard.once = 0)			\
+			hlist_for_each_entry_probe(obj, &name[__bkt], member)
+
+/**
+ * hash_for_each_striped - iterate over a hashtable one locked bucket at a time
+ * @name: hashtable to iterate
+ * @stripes: stripe array protecting @name
+ * @bkt: integer to use as bucket loop cursor
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ *
+ * Each bucket is a consistent snapshot, the table as a whole is not.
+ */
+#define hash_for_each_striped(name, stripes, bkt, obj, member)		\
+	for ((bkt) = 0, obj = NULL; obj == NULL && (bkt) < HASH_SIZE(name);\
+			(bkt)++)					\
+		for (__hash_stripe_guard(__guard, stripes, bkt);	\
+		     __guard.once; __guard.once = 0)			\
+			hlist_for_each_entry(obj, &name[bkt], member)
+
+#endif /* __HASHTABLE_STRIPED_H__ */
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "hashtable_striped.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+#define TABLE_BITS   16
+#define STRIPE_BITS  8
+#define PER_THREAD   (1 << 14)
+
+struct item
+{
+    uint32_t key;
+    struct hlist_node node;
+};
+
+DEFINE_HASHTABLE(table, TABLE_BITS);
+DEFINE_HASH_STRIPES(table_locks, STRIPE_BITS);
+
+static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ops_per_thread;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static bool find_striped(uint32_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible_striped(table, table_locks, obj, node, key) {
+        if (obj->key == key)
+            return true;
+    }
+
+    return false;
+}
+
+static bool find_global(uint32_t key)
+{
+    struct item *obj;
+    bool found = false;
+
+    pthread_mutex_lock(&global_lock);
+    hash_for_each_possible(table, obj, node, key) {
+        if (obj->key == key) {
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&global_lock);
+
+    return found;
+}
+
+struct worker_arg
+{
+    int id;
+    int striped;
+    struct item *items;
+    unsigned long misses;
+};
+
+/*
+ * each thread owns PER_THREAD keys and cycles through insert, lookup and
+ * delete of them; every thread's keys are spread over the whole table
+ */
+static void *worker(void *arg)
+{
+    struct worker_arg *wa = (struct worker_arg *)arg;
+    struct item *it;
+    int i;
+
+    for (i = 0; i < ops_per_thread; i++) {
+        it = &wa->items[i % PER_THREAD];
+
+        if (wa->striped) {
+            hash_add_striped(table, table_locks, &it->node, it->key);
+            if (!find_striped(it->key))
+                wa->misses++;
+            hash_del_striped(table, table_locks, &it->node, it->key);
+        } else {
+            pthread_mutex_lock(&global_lock);
+            hash_add(table, &it->node, it->key);
+            pthread_mutex_unlock(&global_lock);
+            if (!find_global(it->key))
+                wa->misses++;
+            pthread_mutex_lock(&global_lock);
+            hash_del(&it->node);
+            pthread_mutex_unlock(&global_lock);
+        }
+    }
+
+    return NULL;
+}
+
+static double run(int nthreads, int striped, unsigned long *misses)
+{
+    pthread_t *tids = (pthread_t *)malloc(sizeof(pthread_t) * nthreads);
+    struct worker_arg *args =
+        (struct worker_arg *)calloc(nthreads, sizeof(struct worker_arg));
+    double t;
+    int i, j;
+
+    for (i = 0; i < nthreads; i++) {
+        args[i].id = i;
+        args[i].striped = striped;
+        args[i].items = (struct item *)malloc(sizeof(struct item) * PER_THREAD);
+        for (j = 0; j < PER_THREAD; j++) {
+            args[i].items[j].key = i * PER_THREAD + j;
+            INIT_HLIST_NODE(&args[i].items[j].node);
+        }
+    }
+
+    t = now();
+    for (i = 0; i < nthreads; i++)
+        pthread_create(&tids[i], NULL, worker, &args[i]);
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(tids[i], NULL);
+        *misses += args[i].misses;
+        free(args[i].items);
+    }
+    t = now() - t;
+
+    free(tids);
+    free(args);
+
+    /* three table operations per iteration */
+    return 3.0 * nthreads * ops_per_thread / t;
+}
+
+void TEST_STRIPED()
+{
+    struct item items[64], *obj;
+    unsigned int bkt;
+    struct hash_probe_stats before, after;
+    int nlocks = ARRAY_SIZE(table_locks);
+    int i, cnt = 0;
+    bool ok = true;
+
+    for (i = 0; i < 64; i++) {
+        items[i].key = i;
+        hash_add_striped(table, table_locks, &items[i].node, items[i].key);
+    }
+
+    hash_for_each_striped(table, table_locks, bkt, obj, node)
+        cnt++;
+    if (cnt != 64)
+        ok = false;
+
+    /* breaking out of the loop must drop the stripe */
+    hash_probe_stats_read(&before);
+    for (i = 0; i < 64; i++)
+        if (!find_striped(i))
+            ok = false;
+    hash_probe_stats_read(&after);
+#ifdef HASHTABLE_STATS
+    if (after.lookups - before.lookups != 64 ||
+        after.probes - before.probes < 64)
+        ok = false;
+#else
+    if (after.lookups || after.probes)
+        ok = false;
+#endif
+    for (i = 0; i < nlocks; i++)
+        if (table_locks[i].lock.locked)
+            ok = false;
+
+    for (i = 0; i < 64; i++)
+        hash_del_striped(table, table_locks, &items[i].node, items[i].key);
+    if (!hash_empty(table))
+        ok = false;
+
+    printf("%-28s", "TEST_STRIPED");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long misses = 0;
+    double s, g;
+    int n, maxthreads;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <max-threads> <ops-per-thread>\n", argv[0]);
+        exit(1);
+    }
+    maxthreads = atoi(argv[1]);
+    ops_per_thread = atoi(argv[2]);
+
+    TEST_STRIPED();
+
+    printf("%-10s%-18s%-18s%-10s\n", "Threads", "Striped(Mops/s)",
+           "Mutex(Mops/s)", "Ratio");
+    for (n = 1; n <= maxthreads; n *= 2) {
+        s = run(n, 1, &misses);
+        g = run(n, 0, &misses);
+        printf("%-10d%-18.3f%-18.3f%-10.2f\n", n, s / 1e6, g / 1e6, s / g);
+    }
+
+    if (misses)
+        printf(KRED "%lu lookups missed their own key\n" RESET, misses);
+
+    return 0;
+}
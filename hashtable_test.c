@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hashtable.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+/* 2^22 heads = 32MB of buckets alone */
+#define TABLE_BITS 22
+
+/* one cache line per object, like a typical container */
+struct item
+{
+    uint64_t key;
+    struct hlist_node node;
+    char payload[40];
+};
+
+DEFINE_HASHTABLE(table, TABLE_BITS);
+DEFINE_SPARSE_HASHTABLE(sparse, TABLE_BITS);
+DEFINE_HASHTABLE(small, 4);
+
+/* string keys live out of line, so comparing one is a miss of its own */
+struct sitem
+{
+    char *name;
+    struct hlist_hnode hnode;
+    char payload[40];
+};
+
+DEFINE_HASHTABLE(strtab, 12);
+DEFINE_HASHTABLE(strtab_big, 14);
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+}
+
+static void report(const char *name, bool ok)
+{
+    printf("%-28s", name);
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+static struct item *lookup(uint64_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible(table, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+static struct item *lookup_small(uint64_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible(small, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+/* batch results must match one-at-a-time lookups, hits and misses alike */
+void TEST_LOOKUP_BATCH(struct item *items, int n)
+{
+    int nk = 1000, i;
+    uint64_t *keys = (uint64_t *)malloc(sizeof(uint64_t) * nk);
+    struct item **out = (struct item **)malloc(sizeof(struct item *) * nk);
+    bool ok = true;
+
+    for (i = 0; i < nk; i++)
+        keys[i] = (i % 3) ? items[rand() % n].key : rand64();
+
+    /* odd count leaves a partial last group */
+    hash_lookup_batch(table, keys, nk - 7, out, node, key);
+    for (i = 0; i < nk - 7; i++)
+        if (out[i] != lookup(keys[i]))
+            ok = false;
+
+    report("TEST_LOOKUP_BATCH", ok);
+
+    free(keys);
+    free(out);
+}
+
+void compare_batch(struct item *items, int n, int batch)
+{
+    int nk = 1 << 22, i, j;
+    uint64_t *keys = (uint64_t *)malloc(sizeof(uint64_t) * nk);
+    struct item **out = (struct item **)malloc(sizeof(struct item *) * nk);
+    unsigned long found = 0;
+    double t, t1, tb;
+
+    for (i = 0; i < nk; i++)
+        keys[i] = items[rand() % n].key;
+    memset(out, 0, sizeof(struct item *) * nk);
+
+    t = now();
+    for (i = 0; i < nk; i++)
+        out[i] = lookup(keys[i]);
+    t1 = now() - t;
+
+    t = now();
+    for (i = 0; i < nk; i += batch) {
+        j = nk - i < batch ? nk - i : batch;
+        hash_lookup_batch(table, keys + i, j, out + i, node, key);
+    }
+    tb = now() - t;
+
+    for (i = 0; i < nk; i++)
+        found += out[i] != NULL;
+
+    printf("%-12s%-12s%-10s%-16s%-16s%-10s\n", "Objects", "Table(MB)",
+           "Batch", "Per-key(ns)", "Batched(ns)", "Speedup");
+    printf("%-12d%-12lu%-10d%-16.1f%-16.1f%-10.2f\n", n,
+           (unsigned long)((sizeof(table) + sizeof(struct item) * n) >> 20),
+           batch, t1 * 1e9 / nk, tb * 1e9 / nk, t1 / tb);
+    if (found != (unsigned long)nk)
+        printf(KRED "lookup mismatch: %lu\n" RESET, found);
+
+    free(keys);
+    free(out);
+}
+
+void TEST_SPARSE()
+{
+    struct item items[300], *obj;
+    struct hlist_node *tmp;
+    unsigned int bkt, i, cnt = 0;
+    bool ok = true;
+
+    hash_init_sparse(sparse);
+    if (!hash_empty_sparse(sparse))
+        ok = false;
+
+    /* keys 0..99 three times over, so some buckets hold several entries */
+    for (i = 0; i < 300; i++) {
+        items[i].key = i % 100 * 0x9e3779b97f4a7c15ULL;
+        hash_add_sparse(sparse, &items[i].node, items[i].key);
+    }
+
+    hash_for_each_sparse(sparse, bkt, obj, node)
+        cnt++;
+    if (cnt != 300 || hash_empty_sparse(sparse))
+        ok = false;
+
+    /* delete from the middle and the front of chains */
+    for (i = 100; i < 300; i++)
+        hash_del_sparse(sparse, &items[i].node);
+    cnt = 0;
+    hash_for_each_sparse(sparse, bkt, obj, node)
+        cnt++;
+    if (cnt != 100)
+        ok = false;
+
+    hash_for_each_sparse_safe(sparse, bkt, tmp, obj, node)
+        hash_del_sparse(sparse, &obj->node);
+    if (!hash_empty_sparse(sparse) || !hash_empty(sparse))
+        ok = false;
+
+    /* the last entry of a bucket leaves by hash_del_sparse(), then hash_del() */
+    hash_add_sparse(sparse, &items[0].node, items[0].key);
+    hash_add_sparse(sparse, &items[100].node, items[100].key);
+    hash_del_sparse(sparse, &items[0].node);
+    if (hash_empty_sparse(sparse))
+        ok = false;
+    hash_del_sparse(sparse, &items[100].node);
+    if (!hash_empty_sparse(sparse))
+        ok = false;
+
+    hash_add_sparse(sparse, &items[1].node, items[1].key);
+    hash_del(&items[1].node);
+    if (!hash_empty_sparse(sparse) ||
+        __hash_occ_next(sparse_occ, HASH_SIZE(sparse), 0) != HASH_SIZE(sparse))
+        ok = false;
+
+    report("TEST_SPARSE", ok);
+}
+
+/* full scan and emptiness check of a 2^22 bucket table holding m entries */
+void compare_sparse(int m)
+{
+    struct item *items = (struct item *)malloc(sizeof(struct item) * m);
+    struct item *obj;
+    unsigned long bkt, c1 = 0, c2 = 0;
+    double t, tf, ts, te, tes;
+    volatile bool e;
+    int i;
+
+    hash_init_sparse(sparse);
+    for (i = 0; i < m; i++) {
+        items[i].key = rand64();
+        hash_add_sparse(sparse, &items[i].node, items[i].key);
+    }
+
+    t = now();
+    hash_for_each(sparse, bkt, obj, node)
+        c1++;
+    tf = now() - t;
+
+    t = now();
+    hash_for_each_sparse(sparse, bkt, obj, node)
+        c2++;
+    ts = now() - t;
+
+    for (i = 0; i < m; i++)
+        hash_del_sparse(sparse, &items[i].node);
+
+    t = now();
+    e = hash_empty(sparse);
+    te = now() - t;
+
+    t = now();
+    e = hash_empty_sparse(sparse);
+    tes = now() - t;
+    (void)e;
+
+    printf("%-12s%-12s%-16s%-16s%-16s%-16s\n", "Buckets", "Entries",
+           "for_each(us)", "sparse(us)", "empty(us)", "sparse(us)");
+    printf("%-12lu%-12d%-16.1f%-16.1f%-16.1f%-16.1f\n",
+           (unsigned long)HASH_SIZE(sparse), m, tf * 1e6, ts * 1e6,
+           te * 1e6, tes * 1e6);
+    if (c1 != (unsigned long)m || c2 != (unsigned long)m)
+        printf(KRED "iteration mismatch: %lu %lu\n" RESET, c1, c2);
+
+    free(items);
+}
+
+#ifdef HASHTABLE_STATS
+/* a _safe walk of k1's bucket in a thread that exits right after */
+static void *walk_safe(void *arg)
+{
+    struct item *obj;
+    struct hlist_node *tmp;
+    uint64_t key = *(uint64_t *)arg;
+
+    hash_for_each_possible_safe(small, obj, tmp, node, key)
+        ;
+    return NULL;
+}
+#endif
+
+/*
+ * 20 entries on one key and 1 on another: the shape is known regardless
+ * of where the two keys land, as long as they land apart
+ */
+void TEST_STATS()
+{
+    struct item items[21];
+    struct hash_stats st;
+    struct hash_probe_stats before, after;
+    uint64_t k1 = 1, k2 = 2;
+    bool ok = true;
+    int i;
+
+    while (hash_min(k2, HASH_BITS(small)) == hash_min(k1, HASH_BITS(small)))
+        k2++;
+
+    hash_init(small);
+    for (i = 0; i < 20; i++) {
+        items[i].key = k1;
+        hash_add(small, &items[i].node, k1);
+    }
+    items[20].key = k2;
+    hash_add(small, &items[20].node, k2);
+
+    hash_probe_stats_read(&before);
+    lookup_small(k2);
+    hash_probe_stats_read(&after);
+
+    hash_stats(small, &st);
+    if (st.buckets != 16 || st.entries != 21 || st.empty != 14 ||
+        st.max_chain != 20 || st.hist[0] != 14 || st.hist[1] != 1 ||
+        st.hist[HASH_STATS_HIST - 1] != 1 || st.mean_chain != 10.5 ||
+        st.empty_ratio != 14 / 16.)
+        ok = false;
+
+#ifdef HASHTABLE_STATS
+    /* one lookup, and the only node in k2's bucket */
+    if (after.lookups - before.lookups != 1 || after.probes - before.probes != 1)
+        ok = false;
+
+    /* counts of exited threads are kept, and reset starts over from zero */
+    pthread_t tid;
+    hash_probe_stats_reset();
+    if (pthread_create(&tid, NULL, walk_safe, &k1) || pthread_join(tid, NULL))
+        ok = false;
+    hash_probe_stats_read(&after);
+    if (after.lookups != 1 || after.probes != 20)
+        ok = false;
+#else
+    if (after.lookups || after.probes)
+        ok = false;
+#endif
+
+    report("TEST_STATS", ok);
+}
+
+static struct sitem *lookup_str(const char *name)
+{
+    size_t len = strlen(name);
+    struct sitem *obj;
+
+    hash_for_each_possible_bytes(strtab, obj, hnode.node, name, len) {
+        if (!strcmp(obj->name, name))
+            return obj;
+    }
+
+    return NULL;
+}
+
+static struct sitem *lookup_hashed(struct hlist_head *tbl, unsigned int bits,
+                                   const char *name)
+{
+    uint64_t hash = hash_bytes(name, strlen(name), 0);
+    struct sitem *obj;
+
+    hlist_for_each_entry(obj, &tbl[hash_64(hash, bits)], hnode.node) {
+        if (obj->hnode.hash == hash && !strcmp(obj->name, name))
+            return obj;
+    }
+
+    return NULL;
+}
+
+static struct sitem *alloc_sitems(int m)
+{
+    struct sitem *items = (struct sitem *)malloc(sizeof(struct sitem) * m);
+    char buf[64];
+    int i;
+
+    for (i = 0; i < m; i++) {
+        snprintf(buf, sizeof(buf), "/usr/share/object/%08x/%d", rand(), i);
+        items[i].name = strdup(buf);
+    }
+
+    return items;
+}
+
+static void free_sitems(struct sitem *items, int m)
+{
+    int i;
+
+    for (i = 0; i < m; i++)
+        free(items[i].name);
+    free(items);
+}
+
+void TEST_HASHED()
+{
+    struct sitem *items = alloc_sitems(1000), *obj;
+    uint64_t hash;
+    bool ok = true;
+    int i, cnt;
+
+    hash_init(strtab);
+    hash_init(strtab_big);
+    for (i = 0; i < 1000; i++)
+        hash_add_hashed(strtab, &items[i].hnode,
+                        hash_bytes(items[i].name, strlen(items[i].name), 0));
+
+    for (i = 0; i < 1000; i++) {
+        hash = hash_bytes(items[i].name, strlen(items[i].name), 0);
+        cnt = 0;
+        hash_for_each_possible_hashed(strtab, obj, hnode, hash) {
+            if (!strcmp(obj->name, items[i].name))
+                cnt++;
+            if (obj->hnode.hash != hash)
+                ok = false;
+        }
+        if (cnt != 1)
+            ok = false;
+    }
+
+    /* a bigger table filled from the cached hashes finds the same objects */
+    hash_move_hashed(strtab, strtab_big);
+    if (!hash_empty(strtab))
+        ok = false;
+    for (i = 0; i < 1000; i++)
+        if (lookup_hashed(strtab_big, HASH_BITS(strtab_big),
+                          items[i].name) != &items[i])
+            ok = false;
+
+    free_sitems(items, 1000);
+    report("TEST_HASHED", ok);
+}
+
+/*
+ * @m string-keyed objects in 4096 buckets, so every lookup walks a chain
+ * of about @m / 4096 nodes: plain lookups compare the key of each one,
+ * hashed lookups only that of the hit.
+ */
+void compare_hashed(int m)
+{
+    struct sitem *items = alloc_sitems(m);
+    unsigned long misses = 0;
+    double tp, th;
+    int i;
+
+    hash_init(strtab);
+    for (i = 0; i < m; i++)
+        hash_add_bytes(strtab, &items[i].hnode.node, items[i].name,
+                       strlen(items[i].name));
+    tp = now();
+    for (i = 0; i < m; i++)
+        if (lookup_str(items[(i * 7919) % m].name) != &items[(i * 7919) % m])
+            misses++;
+    tp = now() - tp;
+
+    hash_init(strtab);
+    for (i = 0; i < m; i++)
+        hash_add_hashed(strtab, &items[i].hnode,
+                        hash_bytes(items[i].name, strlen(items[i].name), 0));
+    th = now();
+    for (i = 0; i < m; i++)
+        if (lookup_hashed(strtab, HASH_BITS(strtab), items[(i * 7919) % m].name)
+            != &items[(i * 7919) % m])
+            misses++;
+    th = now() - th;
+
+    printf("%-18s%-18s%-18s%-10s\n", "Chain length", "Keys(ns/op)",
+           "Cached(ns/op)", "Speedup");
+    printf("%-18.1f%-18.1f%-18.1f%-10.2f\n", (double)m / HASH_SIZE(strtab),
+           tp * 1e9 / m, th * 1e9 / m, tp / th);
+    if (misses)
+        printf(KRED "%lu lookups failed\n" RESET, misses);
+
+    free_sitems(items, m);
+}
+
+static void print_stats(const char *name, struct hash_stats *st)
+{
+    int i;
+
+    printf("%s: %lu entries in %lu buckets, load %.2f, mean chain %.2f, "
+           "max chain %lu, %.1f%% empty\n", name, st->entries, st->buckets,
+           st->load_factor, st->mean_chain, st->max_chain,
+           st->empty_ratio * 100);
+    printf("  chain length histogram:");
+    for (i = 0; i < HASH_STATS_HIST; i++)
+        if (st->hist[i])
+            printf(" %d%s:%lu", i, i == HASH_STATS_HIST - 1 ? "+" : "",
+                   st->hist[i]);
+    printf("\n");
+    if (st->probes.lookups)
+        printf("  %.2f probes per lookup over %lu lookups\n",
+               (double)st->probes.probes / st->probes.lookups,
+               st->probes.lookups);
+}
+
+int main(int argc, char **argv)
+{
+    struct item *items;
+    struct hash_stats st;
+    int n, batch, i;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <nobjects> <batch>\n", argv[0]);
+        exit(1);
+    }
+    n = atoi(argv[1]);
+    batch = atoi(argv[2]);
+
+    srand((unsigned)time(0));
+    items = (struct item *)malloc(sizeof(struct item) * n);
+    hash_init(table);
+    for (i = 0; i < n; i++) {
+        items[i].key = rand64();
+        hash_add(table, &items[i].node, items[i].key);
+    }
+
+    TEST_LOOKUP_BATCH(items, n);
+    TEST_SPARSE();
+    TEST_STATS();
+    TEST_HASHED();
+    compare_batch(items, n, batch);
+    compare_sparse(1000);
+    compare_hashed(1 << 16);
+
+    hash_stats(table, &st);
+    print_stats("table", &st);
+
+    free(items);
+    return 0;
+}
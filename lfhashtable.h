@@ -0,0 +1,410 @@
+#ifndef __LFHASHTABLE_H__
+#define __LFHASHTABLE_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "hash.h"
+#include "rcu.h"
+
+/*
+ * Lock-free resizable hash table with split-ordered lists
+ * (Shalev & Shavit, "Split-Ordered Lists: Lock-Free Extensible Hash
+ * Tables", JACM 2006).
+ *
+ * All entries live in one lock-free sorted singly linked list (Harris and
+ * Michael: the low bit of ->next marks a node as logically deleted). The
+ * list is sorted by the bit-reversed hash, so the entries of bucket b are
+ * contiguous and bucket b splits into b and b + size by inserting a single
+ * dummy node, never by moving entries. The bucket array only holds
+ * pointers to dummy nodes, which are created lazily the first time a
+ * bucket is used; growing the table is one CAS on the bucket count.
+ *
+ * The bucket array is a set of segments, segment s holding buckets
+ * [2^(s-1), 2^s), so it can be extended without copying.
+ *
+ * Memory is reclaimed with RCU: every operation runs inside
+ * rcu_read_lock(), so calling threads must be registered with
+ * rcu_register_thread(). Nodes belong to the caller. A node returned by
+ * lfhash_del() is already unlinked, but may still be seen by concurrent
+ * readers, so free it with call_rcu() or after synchronize_rcu(). A node
+ * returned by lfhash_lookup() is only safe to use inside the caller's own
+ * rcu_read_lock() section.
+ */
+
+#define LFHASH_MAX_BITS		32
+#define LFHASH_LOAD		2	/* double buckets past 2 entries each */
+
+struct lfhash_node
+{
+	struct lfhash_node *next;	/* bit 0 set: logically deleted */
+	uint64_t so_key;		/* split-order key, odd for entries */
+	uint64_t key;
+};
+
+struct lfhashtable
+{
+	struct lfhash_node **segments[LFHASH_MAX_BITS + 1];
+	unsigned long size;		/* number of buckets, a power of two */
+	unsigned long count;		/* entries */
+};
+
+#define __lf_marked(p)		((uintptr_t)(p) & 1)
+#define __lf_mark(p)		((struct lfhash_node *)((uintptr_t)(p) | 1))
+#define __lf_unmark(p)		((struct lfhash_node *)((uintptr_t)(p) & ~(uintptr_t)1))
+
+#define __lf_load(p)		__atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define __lf_cas(p, old, new)						\
+	__atomic_compare_exchange_n(&(p), &(old), (new), false,	\
+				    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+static inline uint64_t __lf_reverse(uint64_t x)
+{
+	x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+	x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+	x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+
+	return __builtin_bswap64(x);
+}
+
+/*
+ * The split-order key of an entry is its hash with the low bit set; the
+ * bucket is the low bits of the reversed hash, i.e. the top bits of
+ * hash_64(), which are the well-mixed ones.
+ */
+static inline uint64_t __lf_so_regular(uint64_t hash)
+{
+	return hash | 1;
+}
+
+static inline uint64_t __lf_so_dummy(unsigned long bkt)
+{
+	return __lf_reverse(bkt);
+}
+
+static inline unsigned long __lf_bucket(uint64_t hash, unsigned long size)
+{
+	return __lf_reverse(hash) & (size - 1);
+}
+
+/* parent bucket: clear the most significant set bit */
+static inline unsigned long __lf_parent(unsigned long bkt)
+{
+	return bkt & ~(1UL << (63 - __builtin_clzl(bkt)));
+}
+
+static inline struct lfhash_node **__lf_slot(struct lfhashtable *t,
+					     unsigned long bkt, bool alloc)
+{
+	unsigned int seg = bkt ? 64 - __builtin_clzl(bkt) : 0;
+	unsigned long off = bkt ? bkt - (1UL << (seg - 1)) : 0;
+	struct lfhash_node **s = __lf_load(t->segments[seg]);
+	struct lfhash_node **expected = NULL;
+
+	if (!s) {
+		if (!alloc)
+			return NULL;
+		s = (struct lfhash_node **)calloc(seg ? 1UL << (seg - 1) : 1,
+						  sizeof(*s));
+		if (!s)
+			return NULL;
+		if (!__lf_cas(t->segments[seg], expected, s)) {
+			free(s);
+			s = expected;
+		}
+	}
+
+	return &s[off];
+}
+
+/*
+ * Find the first node >= (so_key, key) after @head. On return *@prev is
+ * the link that points at *@cur. Marked nodes met on the way are unlinked;
+ * if that races with another update the walk restarts from @head.
+ */
+static inline bool __lf_find(struct lfhash_node *head, uint64_t so_key,
+			     uint64_t key, struct lfhash_node ***prev,
+			     struct lfhash_node **cur)
+{
+	struct lfhash_node **p, *c, *next;
+
+retry:
+	p = &head->next;
+	c = __lf_unmark(__lf_load(*p));
+
+	for (;;) {
+		if (!c) {
+			*prev = p;
+			*cur = NULL;
+			return false;
+		}
+
+		next = __lf_load(c->next);
+		if (__lf_marked(next)) {
+			struct lfhash_node *expected = c;
+
+			if (!__lf_cas(*p, expected, __lf_unmark(next)))
+				goto retry;
+			c = __lf_unmark(next);
+			continue;
+		}
+
+		if (c->so_key > so_key || (c->so_key == so_key && c->key >= key)) {
+			*prev = p;
+			*cur = c;
+			return c->so_key == so_key && c->key == key;
+		}
+
+		p = &c->next;
+		c = next;
+	}
+}
+
+static inline struct lfhash_node *__lf_get_bucket(struct lfhashtable *t,
+						  unsigned long bkt);
+
+static inline struct lfhash_node *__lf_init_bucket(struct lfhashtable *t,
+						   unsigned long bkt)
+{
+	struct lfhash_node *parent, *dummy, *cur, *expected;
+	struct lfhash_node **slot, **prev;
+
+	parent = __lf_get_bucket(t, __lf_parent(bkt));
+	slot = __lf_slot(t, bkt, true);
+	if (!parent || !slot)
+		return NULL;
+
+	dummy = (struct lfhash_node *)malloc(sizeof(*dummy));
+	if (!dummy)
+		return NULL;
+	dummy->so_key = __lf_so_dummy(bkt);
+	dummy->key = 0;
+
+	for (;;) {
+		if (__lf_find(parent, dummy->so_key, 0, &prev, &cur)) {
+			/* someone else linked this bucket's dummy first */
+			free(dummy);
+			dummy = cur;
+			break;
+		}
+		dummy->next = cur;
+		expected = cur;
+		if (__lf_cas(*prev, expected, dummy))
+			break;
+	}
+
+	expected = NULL;
+	__lf_cas(*slot, expected, dummy);
+
+	return dummy;
+}
+
+static inline struct lfhash_node *__lf_get_bucket(struct lfhashtable *t,
+						  unsigned long bkt)
+{
+	struct lfhash_node **slot = __lf_slot(t, bkt, false);
+	struct lfhash_node *dummy = slot ? __lf_load(*slot) : NULL;
+
+	return dummy ? dummy : __lf_init_bucket(t, bkt);
+}
+
+static inline struct lfhash_node *__lf_bucket_of(struct lfhashtable *t,
+						 uint64_t hash)
+{
+	return __lf_get_bucket(t, __lf_bucket(hash, __lf_load(t->size)));
+}
+
+/**
+ * lfhash_init - initialize a lock-free hashtable
+ * @t: the table to initialize
+ *
+ * Returns 0 on success and -ENOMEM on allocation failure.
+ */
+static inline int lfhash_init(struct lfhashtable *t)
+{
+	struct lfhash_node *head;
+	unsigned int i;
+
+	for (i = 0; i <= LFHASH_MAX_BITS; i++)
+		t->segments[i] = NULL;
+	t->size = 2;
+	t->count = 0;
+
+	head = (struct lfhash_node *)malloc(sizeof(*head));
+	if (!head || !__lf_slot(t, 0, true)) {
+		free(head);
+		return -ENOMEM;
+	}
+	head->next = NULL;
+	head->so_key = __lf_so_dummy(0);
+	head->key = 0;
+	*__lf_slot(t, 0, false) = head;
+
+	return 0;
+}
+
+/**
+ * lfhash_destroy - free the dummy nodes and bucket segments
+ * @t: the table to destroy
+ *
+ * No other thread may use the table any more. Entries still linked are
+ * not touched; remove and free them first if they are heap allocated.
+ */
+static inline void lfhash_destroy(struct lfhashtable *t)
+{
+	struct lfhash_node *pos = *__lf_slot(t, 0, false), *next;
+	unsigned int i;
+
+	for (; pos; pos = next) {
+		next = __lf_unmark(pos->next);
+		if (!(pos->so_key & 1))
+			free(pos);
+	}
+
+	for (i = 0; i <= LFHASH_MAX_BITS; i++) {
+		free(t->segments[i]);
+		t->segments[i] = NULL;
+	}
+}
+
+static inline unsigned long lfhash_count(struct lfhashtable *t)
+{
+	return __lf_load(t->count);
+}
+
+/**
+ * lfhash_add - insert a node into a lock-free hashtable
+ * @t: the table to add to
+ * @node: the &struct lfhash_node embedded in the object
+ * @key: the key of the object
+ *
+ * Returns 0 on success, -EEXIST if @key is already present (the node was
+ * never published and can be freed right away) and -ENOMEM if a bucket
+ * could not be initialized.
+ */
+static inline int lfhash_add(struct lfhashtable *t, struct lfhash_node *node,
+			     uint64_t key)
+{
+	uint64_t hash = hash_64(key, 64);
+	struct lfhash_node *head, **prev, *cur;
+	unsigned long size, count;
+	int ret = 0;
+
+	node->so_key = __lf_so_regular(hash);
+	node->key = key;
+
+	rcu_read_lock();
+	head = __lf_bucket_of(t, hash);
+	if (!head) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (;;) {
+		if (__lf_find(head, node->so_key, key, &prev, &cur)) {
+			ret = -EEXIST;
+			goto out;
+		}
+		node->next = cur;
+		if (__lf_cas(*prev, cur, node))
+			break;
+	}
+
+	count = __atomic_add_fetch(&t->count, 1, __ATOMIC_RELAXED);
+	size = __lf_load(t->size);
+	if (count > size * LFHASH_LOAD && size < (1UL << LFHASH_MAX_BITS))
+		__lf_cas(t->size, size, size * 2);
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
+/**
+ * lfhash_lookup - find the node stored under @key
+ * @t: the table to search
+ * @key: the key to look up
+ *
+ * Call inside rcu_read_lock() and use the result before unlocking.
+ */
+static inline struct lfhash_node *lfhash_lookup(struct lfhashtable *t,
+						uint64_t key)
+{
+	uint64_t hash = hash_64(key, 64);
+	struct lfhash_node *head, **prev, *cur = NULL;
+
+	rcu_read_lock();
+	head = __lf_bucket_of(t, hash);
+	if (!head || !__lf_find(head, __lf_so_regular(hash), key, &prev, &cur))
+		cur = NULL;
+	rcu_read_unlock();
+
+	return cur;
+}
+
+/**
+ * lfhash_del - remove the node stored under @key
+ * @t: the table to remove from
+ * @key: the key to remove
+ *
+ * Returns the unlinked node, or NULL if @key wasn't present. Wait for a
+ * grace period before freeing or reusing it.
+ */
+static inline struct lfhash_node *lfhash_del(struct lfhashtable *t,
+					     uint64_t key)
+{
+	uint64_t hash = hash_64(key, 64);
+	uint64_t so_key = __lf_so_regular(hash);
+	struct lfhash_node *head, **prev, *cur = NULL, *next, *expected;
+
+	rcu_read_lock();
+	head = __lf_bucket_of(t, hash);
+	if (!head)
+		goto out;
+
+	for (;;) {
+		if (!__lf_find(head, so_key, key, &prev, &cur)) {
+			cur = NULL;
+			goto out;
+		}
+
+		/* logical delete: whoever sets the mark owns the removal */
+		next = __lf_load(cur->next);
+		if (__lf_marked(next))
+			continue;
+		if (__lf_cas(cur->next, next, __lf_mark(next)))
+			break;
+	}
+
+	/*
+	 * Physical unlink, or let __lf_find() finish it if we lose the race:
+	 * either way the node is off the list before the caller starts its
+	 * grace period.
+	 */
+	expected = cur;
+	if (!__lf_cas(*prev, expected, next))
+		__lf_find(head, so_key, key, &prev, &next);
+
+	__atomic_sub_fetch(&t->count, 1, __ATOMIC_RELAXED);
+out:
+	rcu_read_unlock();
+	return cur;
+}
+
+/**
+ * lfhash_for_each - iterate over the entries of a lock-free hashtable
+ * @t: the &struct lfhashtable to iterate
+ * @pos: the struct lfhash_node * to use as a loop cursor
+ *
+ * Walks the whole split-ordered list, skipping dummy and deleted nodes.
+ * Call inside rcu_read_lock(); concurrent updates may or may not be seen.
+ */
+#define lfhash_for_each(t, pos)						\
+	for (pos = __lf_unmark(__lf_load((*__lf_slot(t, 0, false))->next));\
+	     pos;							\
+	     pos = __lf_unmark(__lf_load((pos)->next)))			\
+		if (!((pos)->so_key & 1 &&				\
+		      !__lf_marked(__lf_load((pos)->next)))) {} else
+
+#endif /* __LFHASHTABLE_H__ */
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lfhashtable.h"
+#include "flathash.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+#define NKEYS  (1 << 16)
+#define LIVE   0x5a5a5a5aU
+
+struct item
+{
+    uint64_t key;
+    uint32_t magic;
+    struct lfhash_node node;
+    struct rcu_head rcu;
+};
+
+#define item_of(ptr, field) \
+    ((struct item *)((char *)(ptr) - offsetof(struct item, field)))
+
+static struct lfhashtable table;
+static struct fhashtable flat;
+static pthread_mutex_t flat_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ops_per_thread;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static struct item *item_alloc(uint64_t key)
+{
+    struct item *it = (struct item *)malloc(sizeof(struct item));
+    it->key = key;
+    it->magic = LIVE;
+    return it;
+}
+
+static void item_free_rcu(struct rcu_head *head)
+{
+    struct item *it = item_of(head, rcu);
+
+    /* a reader that still saw this object would now read a bad magic */
+    it->magic = 0;
+    free(it);
+}
+
+struct worker_arg
+{
+    int lockfree;
+    unsigned int seed;
+    unsigned long bad;
+};
+
+/*
+ * every thread works on the same key range: 50% lookups, 25% inserts and
+ * 25% deletes, so nodes are constantly raced for and retired under readers
+ */
+static void *worker(void *arg)
+{
+    struct worker_arg *wa = (struct worker_arg *)arg;
+    struct lfhash_node *n;
+    struct item *it;
+    uint64_t key;
+    int i, op;
+
+    rcu_register_thread();
+    for (i = 0; i < ops_per_thread; i++) {
+        op = rand_r(&wa->seed);
+        key = (op >> 2) % NKEYS;
+
+        if (wa->lockfree) {
+            switch (op & 3) {
+            case 0:
+                it = item_alloc(key);
+                if (lfhash_add(&table, &it->node, key))
+                    free(it);
+                break;
+            case 1:
+                n = lfhash_del(&table, key);
+                if (n)
+                    call_rcu(&item_of(n, node)->rcu, item_free_rcu);
+                break;
+            default:
+                rcu_read_lock();
+                n = lfhash_lookup(&table, key);
+                if (n && (item_of(n, node)->magic != LIVE ||
+                          item_of(n, node)->key != key))
+                    wa->bad++;
+                rcu_read_unlock();
+            }
+        } else {
+            pthread_mutex_lock(&flat_lock);
+            switch (op & 3) {
+            case 0:
+                it = item_alloc(key);
+                if (fhash_add(&flat, key, it))
+                    free(it);
+                break;
+            case 1:
+                free(fhash_del(&flat, key));
+                break;
+            default:
+                it = (struct item *)fhash_lookup(&flat, key);
+                if (it && it->key != key)
+                    wa->bad++;
+            }
+            pthread_mutex_unlock(&flat_lock);
+        }
+    }
+    rcu_unregister_thread();
+
+    return NULL;
+}
+
+static double run(int nthreads, int lockfree, unsigned long *bad)
+{
+    pthread_t *tids = (pthread_t *)malloc(sizeof(pthread_t) * nthreads);
+    struct worker_arg *args =
+        (struct worker_arg *)calloc(nthreads, sizeof(struct worker_arg));
+    double t;
+    int i;
+
+    t = now();
+    for (i = 0; i < nthreads; i++) {
+        args[i].lockfree = lockfree;
+        args[i].seed = i + 1;
+        pthread_create(&tids[i], NULL, worker, &args[i]);
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(tids[i], NULL);
+        *bad += args[i].bad;
+    }
+    t = now() - t;
+
+    free(tids);
+    free(args);
+
+    return (double)nthreads * ops_per_thread / t;
+}
+
+/* the list must stay sorted by split-order key with each key at most once */
+static bool check_table(void)
+{
+    struct lfhash_node *pos, *prev = NULL;
+    unsigned long cnt = 0, left;
+    bool ok = true;
+
+    rcu_read_lock();
+    lfhash_for_each(&table, pos) {
+        if (prev && (prev->so_key > pos->so_key ||
+                     (prev->so_key == pos->so_key && prev->key >= pos->key)))
+            ok = false;
+        prev = pos;
+        cnt++;
+    }
+
+    /* an else after the loop belongs to the caller's if */
+    left = cnt;
+    if (cnt == lfhash_count(&table))
+        lfhash_for_each(&table, pos)
+            left--;
+    else
+        ok = false;
+    rcu_read_unlock();
+
+    return ok && !left;
+}
+
+void TEST_LFHASH()
+{
+    struct item items[1000];
+    struct lfhash_node *n;
+    bool ok = true;
+    int i;
+
+    rcu_register_thread();
+    for (i = 0; i < 1000; i++)
+        if (lfhash_add(&table, &items[i].node, i * 7919))
+            ok = false;
+    if (lfhash_add(&table, &items[0].node, 0) != -EEXIST)
+        ok = false;
+
+    /* 1000 entries must have grown the table from its initial 2 buckets */
+    if (lfhash_count(&table) != 1000 || table.size < 1000 / LFHASH_LOAD)
+        ok = false;
+    if (!check_table())
+        ok = false;
+
+    rcu_read_lock();
+    for (i = 0; i < 1000; i++)
+        if (lfhash_lookup(&table, i * 7919) != &items[i].node)
+            ok = false;
+    if (lfhash_lookup(&table, 1))
+        ok = false;
+    rcu_read_unlock();
+
+    for (i = 0; i < 1000; i += 2)
+        if (lfhash_del(&table, i * 7919) != &items[i].node)
+            ok = false;
+    for (i = 0; i < 1000; i++) {
+        rcu_read_lock();
+        n = lfhash_lookup(&table, i * 7919);
+        rcu_read_unlock();
+        if ((i & 1) ? n != &items[i].node : n != NULL)
+            ok = false;
+    }
+    for (i = 1; i < 1000; i += 2)
+        lfhash_del(&table, i * 7919);
+    if (lfhash_count(&table) != 0 || !check_table())
+        ok = false;
+    rcu_unregister_thread();
+
+    printf("%-28s", "TEST_LFHASH");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+int main(int argc, char **argv)
+{
+    struct lfhash_node *n;
+    struct fhash_slot *slot;
+    unsigned long i, bad = 0;
+    double l, m;
+    int k, maxthreads;
+    bool ok;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <max-threads> <ops-per-thread>\n", argv[0]);
+        exit(1);
+    }
+    maxthreads = atoi(argv[1]);
+    ops_per_thread = atoi(argv[2]);
+
+    if (lfhash_init(&table) || fhash_init(&flat, 4)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    TEST_LFHASH();
+
+    printf("%-10s%-18s%-18s%-10s\n", "Threads", "Lock-free(Mops/s)",
+           "Mutex(Mops/s)", "Ratio");
+    for (k = 1; k <= maxthreads; k *= 2) {
+        l = run(k, 1, &bad);
+        m = run(k, 0, &bad);
+        printf("%-10d%-18.3f%-18.3f%-10.2f\n", k, l / 1e6, m / 1e6, l / m);
+    }
+
+    rcu_register_thread();
+    ok = !bad && check_table();
+    rcu_unregister_thread();
+    printf("%-28s", "TEST_LFHASH_STRESS");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED (%lu bad reads)\n" RESET, bad);
+
+    rcu_register_thread();
+    rcu_read_lock();
+    lfhash_for_each(&table, n) {
+        lfhash_del(&table, item_of(n, node)->key);
+        call_rcu(&item_of(n, node)->rcu, item_free_rcu);
+    }
+    rcu_read_unlock();
+    rcu_unregister_thread();
+    rcu_barrier();
+    lfhash_destroy(&table);
+
+    fhash_for_each(&flat, i, slot)
+        free(slot->obj);
+    fhash_destroy(&flat);
+
+    return 0;
+}
@@ -2,8 +2,12 @@
 #define __LIST_H
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <sched.h>
+#include <pthread.h>
 
 /*
  * simplified single linked list implementation
@@ -21,18 +25,140 @@ struct node
     struct node *next;
 };
 
+/*
+ * node pool: nodes are carved out of slabs of slab_nodes nodes and recycled
+ * through a free-list threaded through their next pointers, so building a
+ * list costs one malloc per slab instead of one per node, the nodes of a
+ * list stay packed together, and node_pool_destroy() releases all of them
+ * with one free per slab.
+ */
+#define NODE_SLAB_NODES 4096
+
+struct node_slab
+{
+    struct node_slab *next;
+    struct node nodes[];
+};
+
+struct node_pool
+{
+    struct node_slab *slabs; /* all slabs, the one being carved up first */
+    struct node *free; /* nodes given back by node_pool_free() */
+    int used; /* nodes handed out of the first slab */
+    int slab_nodes; /* nodes per slab */
+};
+
 struct linked_list 
 {
     struct node *head; /* head of the single linked list */
     struct node *tail; /* tail of the single linked list */
     int len; /* length of the single linked list */
+    struct node_pool *pool; /* where nodes come from, NULL for malloc() */
 };
 
+/*
+ * @slab_nodes: nodes per slab, NODE_SLAB_NODES when <= 0
+ */
+void node_pool_init(struct node_pool *pool, int slab_nodes)
+{
+    pool->slabs = NULL;
+    pool->free = NULL;
+    pool->slab_nodes = slab_nodes > 0 ? slab_nodes : NODE_SLAB_NODES;
+    pool->used = pool->slab_nodes;
+}
+
+/*
+ * get a node from the pool, NULL when a new slab can't be allocated
+ * Time Complexity: O(1)
+ */
+struct node * node_pool_alloc(struct node_pool *pool)
+{
+    struct node *p = pool->free;
+
+    if (p) {
+        pool->free = p->next;
+        return p;
+    }
+
+    /* the free-list is empty, carve the next node out of the first slab */
+    if (pool->used == pool->slab_nodes) {
+        struct node_slab *s = (struct node_slab *)malloc(sizeof(struct node_slab)
+                + sizeof(struct node) * pool->slab_nodes);
+        if (NULL == s) return NULL;
+
+        s->next = pool->slabs;
+        pool->slabs = s;
+        pool->used = 0;
+    }
+
+    return &pool->slabs->nodes[pool->used++];
+}
+
+/*
+ * give a node back to the pool it came from
+ * Time Complexity: O(1)
+ */
+void node_pool_free(struct node_pool *pool, struct node *p)
+{
+    p->next = pool->free;
+    pool->free = p;
+}
+
+/*
+ * release every slab at once, including nodes still linked into lists
+ * Time Complexity: O(number of slabs)
+ */
+void node_pool_destroy(struct node_pool *pool)
+{
+    struct node_slab *s = pool->slabs, *next = NULL;
+
+    while (s) {
+        next = s->next;
+        free(s);
+        s = next;
+    }
+
+    node_pool_init(pool, pool->slab_nodes);
+}
+
 void list_init(struct linked_list *list)
 {
     list->head = NULL;
     list->tail = NULL;
     list->len = 0;
+    list->pool = NULL;
+}
+
+/*
+ * initialize an empty list whose nodes come from @pool, several lists may
+ * share a pool. Such a list must only ever hold nodes of its pool.
+ */
+void list_init_pool(struct linked_list *list, struct node_pool *pool)
+{
+    list_init(list);
+    list->pool = pool;
+}
+
+/*
+ * allocate a node holding value, from the pool of the list if it has one
+ */
+struct node * list_node_alloc(struct linked_list *list, int value)
+{
+    struct node *p = list->pool ? node_pool_alloc(list->pool)
+        : (struct node *)malloc(sizeof(struct node));
+    p->data = value;
+    p->next = NULL;
+
+    return p;
+}
+
+/*
+ * release a node allocated with list_node_alloc()
+ */
+void list_node_free(struct linked_list *list, struct node *p)
+{
+    if (list->pool) node_pool_free(list->pool, p);
+    else free(p);
 }
 
 /*
@@ -100,9 +226,7 @@ void list_tadd(struct linked_list *list, struct node *p)
  */
 void list_append(struct linked_list *list, int value)
 {
-    struct node *p = (struct node *)malloc(sizeof(struct node));
-    p->data = value;
-    p->next = NULL;
+    struct node *p = list_node_alloc(list, value);
 
     list_tadd(list, p);
 }
@@ -140,7 +264,7 @@ void list_del(struct linked_list *list, struct node *p)
             prev->next = p->next;
         }
         list->len--;
-        free(p);
+        list_node_free(list, p);
     }
 }
 
@@ -190,22 +314,39 @@ void list_destroy(struct linked_list *list)
     while (p) {
         prev = p;
         p = p->next;
-        free(prev);
+        list_node_free(list, prev);
     }
     (list)->len = 0;
 
     free(list);
 }
 
+/*
+ * destroy a list together with the pool its nodes come from: the nodes are
+ * released slab by slab without walking the list. Other lists sharing the
+ * pool are destroyed along with it.
+ * Time Complexity: O(number of slabs)
+ */
+void list_destroy_pool(struct linked_list *list)
+{
+    if (NULL == list) return;
+
+    if (NULL == list->pool) {
+        list_destroy(list);
+        return;
+    }
+
+    node_pool_destroy(list->pool);
+    free(list);
+}
+
 /* 
  * add a new head node, used to construct STACK
  * Time Complexity: O(1)
  */
 void list_push(struct linked_list *list, int value)
 {
-    struct node *p = (struct node *)malloc(sizeof(struct node));
-    p->data = value;
-    p->next = NULL;
+    struct node *p = list_node_alloc(list, value);
     list_hadd(list, p); 
 }
 
@@ -227,7 +368,7 @@ int list_pop(struct linked_list *list)
 
     list->head = list->head->next;
     list->len--;
-    free(p); 
+    list_node_free(list, p); 
 
     return ret;
 }
@@ -240,9 +381,7 @@ void list_insert_nth(struct linked_list *list, int idx, int value)
 {
     if ((idx < 0) || (idx >= list_length(list))) return;
 
-    struct node *p = (struct node *)malloc(sizeof(struct node));
-    p->data = value;
-    p->next = NULL;
+    struct node *p = list_node_alloc(list, value);
 
     if (0 == idx) {
         list_hadd(list, p);
@@ -334,6 +473,7 @@ struct linked_list * list_merge(struct linked_list *a, struct linked_list *b)
     struct node *ap = a->head, *bp = b->head, *prev = NULL;
 
     list_init(list);
+    list->pool = a->pool ? a->pool : b->pool;
 
     while (ap && bp) {
         if (ap->data <= bp->data) {
@@ -385,8 +525,8 @@ void list_mergesort(struct linked_list **list)
     list_fh = (struct linked_list *)malloc(sizeof(struct linked_list));
     list_lh = (struct linked_list *)malloc(sizeof(struct linked_list));
 
-    list_init(list_fh);
-    list_init(list_lh);
+    list_init_pool(list_fh, (*list)->pool);
+    list_init_pool(list_lh, (*list)->pool);
 
     list_fh->head = (*list)->head;
     list_fh->tail = prev;
@@ -426,6 +566,7 @@ void list_mergesort2(struct linked_list **list)
     int lev; /* index to part[] */
     int max_lev = 0;
     struct node *p;
+    struct node_pool *pool = (*list)->pool;
 
     if (list_is_empty(*list))
         return;
@@ -465,6 +606,247 @@ void list_mergesort2(struct linked_list **list)
     for (lev = 0; lev <= max_lev; lev++)
         if (!list_is_empty(&part[lev]))
             *list = list_merge(&part[lev], *list);
+    (*list)->pool = pool;
+}
+
+/*
+ * list_radixsort - LSD radix sort list
+ * @list: list to sort
+ *
+ * Each pass distributes the nodes into 256 buckets by one byte of their
+ * data, least significant byte first, and chains the buckets back together
+ * in order. Nodes are only relinked, never copied or allocated, and the
+ * sort is stable. The sign bit is flipped to order negative values first,
+ * and passes over bytes that are the same in every value are skipped.
+ *
+ * Time Complexity: O(n)
+ * Space Complexity: O(1)
+ */
+void list_radixsort(struct linked_list *list)
+{
+    struct node *bucket[256];
+    struct node **end[256]; /* next pointer of the last node of bucket */
+    struct node *p = NULL, **link = NULL;
+    unsigned int first, diff = 0, key;
+    int shift, b;
+
+    if (NULL == list || list->len < 2) return;
+
+    /* bits set in diff vary between values, other bytes need no pass */
+    first = (unsigned int)list->head->data;
+    for (p = list->head; p != NULL; p = p->next)
+        diff |= (unsigned int)p->data ^ first;
+    if (0 == diff) return;
+
+    for (shift = 0; shift < 32; shift += 8) {
+        if (0 == ((diff >> shift) & 0xff)) continue;
+
+        for (b = 0; b < 256; b++) {
+            bucket[b] = NULL;
+            end[b] = &bucket[b];
+        }
+
+        for (p = list->head; p != NULL; p = p->next) {
+            key = ((unsigned int)p->data ^ 0x80000000u) >> shift & 0xff;
+            *end[key] = p;
+            end[key] = &p->next;
+        }
+
+        link = &list->head;
+        for (b = 0; b < 256; b++) {
+            if (NULL == bucket[b]) continue;
+            *link = bucket[b];
+            link = end[b];
+        }
+        *link = NULL;
+    }
+
+    /* link is the next pointer of the last node */
+    list->tail = (struct node *)((char *)link - offsetof(struct node, next));
+}
+
+/*
+ * a NULL terminated chain of nodes with its last node
+ */
+struct list_run
+{
+    struct node *head;
+    struct node *tail;
+};
+
+/*
+ * merge sorted run @b into sorted run @a, nodes of @a first on ties
+ * Time Complexity: O(a + b)
+ * Space Complexity: O(1)
+ */
+void __list_merge_runs(struct list_run *a, struct list_run *b)
+{
+    struct node head, *t = &head, *ap = a->head, *bp = b->head;
+
+    while (ap && bp) {
+        if (ap->data <= bp->data) {
+            t->next = ap;
+            t = ap;
+            ap = ap->next;
+        } else {
+            t->next = bp;
+            t = bp;
+            bp = bp->next;
+        }
+    }
+    t->next = ap ? ap : bp;
+
+    a->head = head.next;
+    a->tail = ap ? a->tail : b->tail;
+}
+
+/*
+ * stable bottom-up merge sort of a run, same scheme as list_mergesort2()
+ * but on bare chains, with no allocation and no length limit
+ * Time Complexity: O(nlgn)
+ * Space Complexity: O(1)
+ */
+void __list_sort_run(struct list_run *run)
+{
+    struct list_run part[32], cur;
+    struct node *p = run->head, *next = NULL;
+    int lev, max_lev = 0;
+
+    for (lev = 0; lev < 32; lev++)
+        part[lev].head = NULL;
+
+    while (p) {
+        next = p->next;
+        p->next = NULL;
+        cur.head = cur.tail = p;
+
+        /* part[lev] holds older nodes than cur, it goes first */
+        for (lev = 0; part[lev].head; lev++) {
+            __list_merge_runs(&part[lev], &cur);
+            cur = part[lev];
+            part[lev].head = NULL;
+        }
+        if (lev > max_lev) max_lev = lev;
+        part[lev] = cur;
+        p = next;
+    }
+
+    cur.head = NULL;
+    for (lev = 0; lev <= max_lev; lev++) {
+        if (NULL == part[lev].head) continue;
+        if (cur.head) __list_merge_runs(&part[lev], &cur);
+        cur = part[lev];
+    }
+    *run = cur;
+}
+
+#define LIST_MAX_THREADS 64
+
+struct list_sort_worker
+{
+    pthread_t tid;
+    int id;
+    int nthreads;
+    struct list_run *runs; /* one per worker, in list order */
+    int *done; /* set once a worker's run is final */
+};
+
+/*
+ * sort the run of worker id, then merge the runs of a binary tree: at
+ * each level worker id merges in the run of worker id + stride as soon as
+ * that one is done, while the other pairs of the level do the same
+ */
+void * __list_sort_worker(void *arg)
+{
+    struct list_sort_worker *w = (struct list_sort_worker *)arg;
+    int stride;
+
+    __list_sort_run(&w->runs[w->id]);
+
+    for (stride = 1; w->id % (2 * stride) == 0 && w->id + stride < w->nthreads;
+         stride *= 2) {
+        while (!__atomic_load_n(&w->done[w->id + stride], __ATOMIC_ACQUIRE))
+            sched_yield();
+        __list_merge_runs(&w->runs[w->id], &w->runs[w->id + stride]);
+    }
+
+    __atomic_store_n(&w->done[w->id], 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*
+ * list_mergesort_parallel - merge sort list with several threads
+ * @list: list to sort
+ * @nthreads: number of threads, the calling thread included; capped at
+ *            LIST_MAX_THREADS and at the length of the list
+ *
+ * The list is cut into @nthreads segments of equal length. Each thread
+ * sorts one with a bottom-up merge sort, then the sorted runs are merged
+ * pairwise up a binary tree, the pairs of a level in parallel. The sort
+ * is stable, and sorting and merging never allocate: nodes are relinked
+ * and the bookkeeping lives on the caller's stack. Starting the threads
+ * is another matter: each of the @nthreads - 1 pthread_create() calls
+ * maps a thread stack, so only @nthreads == 1 is allocation-free, and for
+ * short lists thread start-up can cost more than it saves. If a thread
+ * can't be created, the calling thread does its share.
+ *
+ * Time Complexity: O(nlgn / nthreads + n)
+ * Space Complexity: O(nthreads)
+ */
+void list_mergesort_parallel(struct linked_list *list, int nthreads)
+{
+    struct list_sort_worker w[LIST_MAX_THREADS];
+    struct list_run runs[LIST_MAX_THREADS];
+    int done[LIST_MAX_THREADS];
+    bool threaded[LIST_MAX_THREADS];
+    struct node *p = NULL;
+    int i, k, seg;
+
+    if (NULL == list || list->len < 2) return;
+    if (nthreads > LIST_MAX_THREADS) nthreads = LIST_MAX_THREADS;
+    if (nthreads > list->len) nthreads = list->len;
+    if (nthreads < 1) nthreads = 1;
+
+    /* cut the list into nthreads runs, the last one takes the remainder */
+    seg = list->len / nthreads;
+    p = list->head;
+    for (i = 0; i < nthreads; i++) {
+        runs[i].head = p;
+        if (i == nthreads - 1) {
+            runs[i].tail = list->tail;
+            break;
+        }
+        for (k = 1; k < seg; k++)
+            p = p->next;
+        runs[i].tail = p;
+        p = p->next;
+        runs[i].tail->next = NULL;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        w[i].id = i;
+        w[i].nthreads = nthreads;
+        w[i].runs = runs;
+        w[i].done = done;
+        done[i] = 0;
+    }
+    for (i = 1; i < nthreads; i++)
+        threaded[i] = 0 == pthread_create(&w[i].tid, NULL,
+                __list_sort_worker, &w[i]);
+
+    /*
+     * workers only wait for workers with higher ids, so the shares left
+     * over run here from the highest id down, ending with worker 0
+     */
+    for (i = nthreads - 1; i > 0; i--)
+        if (!threaded[i]) __list_sort_worker(&w[i]);
+    __list_sort_worker(&w[0]);
+
+    for (i = 1; i < nthreads; i++)
+        if (threaded[i]) pthread_join(w[i].tid, NULL);
+
+    list->head = runs[0].head;
+    list->tail = runs[0].tail;
 }
 
 /*
@@ -507,89 +889,111 @@ struct node * list_partition(struct linked_list *list)
 
     if (q->data == key) return q;
 
-    for (h = q; h->data != key; h = h->next);
+    /* move the first node holding the key in front of q */
+    struct node *hprev = q;
+    for (h = q->next; h->data != key; hprev = h, h = h->next);
 
-    list_del(list, h);
-
-    h = (struct node *)malloc(sizeof(struct node));
-    h->data = key;
-    h->next = NULL;
-    if (prev) {
-        prev->next = h;
-        h->next = q;
-        list->len++;
-    } else {
-        list_hadd(list, h);
-    }
+    hprev->next = h->next;
+    if (list->tail == h) list->tail = hprev;
+    h->next = q;
+    if (prev) prev->next = h;
+    else list->head = h;
 
     return h;
 }
 
 /*
- * quicksort the list
- * Time Complexity: O(n log n)
- * Space Complexity: O(log n)
+ * median of three values
  */
-void list_quicksort(struct linked_list *list)
+int __list_median3(int a, int b, int c)
 {
-    struct node *p = list_partition(list);
-    if (NULL == p) return;
-
-    int len = list_length(list);
-    int cnt = 0;
-    struct node *q = NULL, *prev = NULL;
-
-    for (q = list->head, cnt = 1; q != p; prev = q, q = q->next, cnt++);
-
-    q = q->next; /* as the head of the latter half list */
+    int t;
 
-    struct linked_list *list_fh = 
-        (struct linked_list *)malloc(sizeof(struct linked_list));
-    struct linked_list *list_lh = 
-        (struct linked_list *)malloc(sizeof(struct linked_list));
-
-    list_init(list_fh);
-    list_init(list_lh);
+    if (a > c) { t = a; a = c; c = t; }
+    return b < a ? a : (b > c ? c : b);
+}
 
-    if (prev) {
-        list_fh->head = list->head;
-        list_fh->tail = prev;
-        list_fh->tail->next = NULL;
-        list_fh->len = cnt - 1;
-    } 
-    
-    if (q) {
-        list_lh->head = q;
-        list_lh->tail = list->tail;
-        list_lh->len = len - cnt;
+/*
+ * quicksort a run of len nodes, mid being its middle node, by relinking
+ * them into less, equal and greater runs; after depth levels of recursion
+ * the run is handed to the bottom-up mergesort instead
+ */
+void __list_quicksort_run(struct list_run *run, struct node *mid, int len,
+        int depth)
+{
+    struct list_run lt = { NULL, NULL }, eq = { NULL, NULL }, gt = { NULL, NULL };
+    struct node **lte = &lt.head, **eqe = &eq.head, **gte = &gt.head;
+    struct node *p = NULL, *ltmid = NULL, *gtmid = NULL;
+    int pivot, nlt = 0, ngt = 0;
+
+    if (len < 2) return;
+    if (0 == depth) {
+        __list_sort_run(run);
+        return;
     }
 
-    list->head = list->tail = NULL;
-    list->len = 0;
-
-    list_quicksort(list_fh);
-    list_quicksort(list_lh);
-
-    if (list_fh->head) {
-        list->head = list_fh->head;
-        list_fh->tail->next = p;
-    } else {
-        list->head = p;
+    /*
+     * p->next is only rewritten once the walk has moved past p. The middle
+     * of each side follows one step for every two nodes appended to it, so
+     * the next level gets its median-of-3 without walking half the run.
+     */
+    pivot = __list_median3(run->head->data, mid->data, run->tail->data);
+    for (p = run->head; p != NULL; p = p->next) {
+        if (p->data < pivot) {
+            *lte = lt.tail = p;
+            lte = &p->next;
+            if (0 == nlt++) ltmid = p;
+            else if (0 == (nlt & 1)) ltmid = ltmid->next;
+        } else if (p->data > pivot) {
+            *gte = gt.tail = p;
+            gte = &p->next;
+            if (0 == ngt++) gtmid = p;
+            else if (0 == (ngt & 1)) gtmid = gtmid->next;
+        } else {
+            *eqe = eq.tail = p;
+            eqe = &p->next;
+        }
     }
-    p->next = list_lh->head;
+    *lte = *eqe = *gte = NULL;
 
-    if (list_lh->tail) {
-        list->tail = list_lh->tail;
-    } else {
-        list->tail = p;
-    }
-    
-    list->len = list_fh->len + list_lh->len + 1;
-    
-    free(list_fh);
-    free(list_lh);
+    __list_quicksort_run(&lt, ltmid, nlt, depth - 1);
+    __list_quicksort_run(&gt, gtmid, ngt, depth - 1);
+
+    /* the pivot is one of the values, so eq is never empty */
+    eq.tail->next = gt.head;
+    if (lt.head) lt.tail->next = eq.head;
+    run->head = lt.head ? lt.head : eq.head;
+    run->tail = gt.head ? gt.tail : eq.tail;
 }
 
+/*
+ * quicksort the list in place: nodes are relinked, never copied or
+ * allocated. Partitions are 3-way (less, equal, greater than a median-of-3
+ * pivot), so duplicates are settled in one pass, and past 2 * lg(n) levels
+ * of recursion the mergesort takes over, so sorted, reversed and all-equal
+ * input stay O(n log n). The sort is stable.
+ * Time Complexity: O(n log n)
+ * Space Complexity: O(log n)
+ */
+void list_quicksort(struct linked_list *list)
+{
+    struct list_run run;
+    struct node *mid = NULL;
+    int n, depth = 0;
+
+    if (NULL == list || list->len < 2) return;
+
+    for (n = list->len; n > 1; n >>= 1)
+        depth += 2;
+    for (mid = list->head, n = 0; n < list->len / 2; n++)
+        mid = mid->next;
+
+    run.head = list->head;
+    run.tail = list->tail;
+    __list_quicksort_run(&run, mid, list->len, depth);
+    list->head = run.head;
+    list->tail = run.tail;
+}
 
 /*
  * sorting based method to remove duplicates in the list
@@ -610,7 +1014,7 @@ void list_rmdup(struct linked_list *list)
             r = p;
             p = p->next;
             q->next = p;
-            free(r);
+            list_node_free(list, r);
         } else {
             q = p;
             p = p->next;
@@ -3,6 +3,7 @@
 #include <time.h>
 #include <string.h>
 #include <sys/time.h> 
+#include <unistd.h>
 #include "list.h"
 
 /* ansi color code */
@@ -92,20 +93,25 @@ void compare_sort(int n, int nt)
     make_array(&a, n);
 
 
-    struct timespec tm1, tm2, tq1, tq2;
+    struct timespec tm1, tm2, tq1, tq2, tr1, tr2;
 
-    printf("%-10s%-6s%-15s%-15s%-15s\n", "Size", "Idx", "MS Time", "QS Time", "Ratio(MS/QS)");
+    printf("%-10s%-6s%-15s%-15s%-15s%-15s%-15s\n", "Size", "Idx", "MS Time", "QS Time",
+           "RS Time", "Ratio(MS/QS)", "Ratio(MS/RS)");
     for (i = 0; i < nt; i++) {
         struct linked_list *list1 =
             (struct linked_list *)malloc(sizeof(struct linked_list));
         struct linked_list *list2 =
             (struct linked_list *)malloc(sizeof(struct linked_list));
+        struct linked_list *list3 =
+            (struct linked_list *)malloc(sizeof(struct linked_list));
 
         list_init(list1);
         list_init(list2);
+        list_init(list3);
 
         make_list(list1, a, n);
         make_list(list2, a, n);
+        make_list(list3, a, n);
 
         memset(&tm1, 0, sizeof(struct timespec));
         memset(&tm2, 0, sizeof(struct timespec));
@@ -120,14 +126,370 @@ void compare_sort(int n, int nt)
         list_mergesort2(&list1);
         current_utc_time(&tm2);
 
+        current_utc_time(&tr1);
+        list_radixsort(list3);
+        current_utc_time(&tr2);
+
         list_destroy(list1);
         list_destroy(list2);
+        list_destroy(list3);
 
         double ttm = tm2.tv_sec - tm1.tv_sec + (tm2.tv_nsec - tm1.tv_nsec) / 1000000000.0;
         double ttq = tq2.tv_sec - tq1.tv_sec + (tq2.tv_nsec - tq1.tv_nsec) / 1000000000.0;
+        double ttr = tr2.tv_sec - tr1.tv_sec + (tr2.tv_nsec - tr1.tv_nsec) / 1000000000.0;
+
+        printf("%-10d%-6d%-15.10f%-15.10f%-15.10f%-15.10f%-15.10f\n", n, i+1, ttm, ttq,
+               ttr, ttm*1./ttq, ttm*1./ttr);
+    }
+}
+
+double elapsed(struct timespec *t1, struct timespec *t2)
+{
+    return t2->tv_sec - t1->tv_sec + (t2->tv_nsec - t1->tv_nsec) / 1000000000.0;
+}
+
+/*
+ * radix sort mixed-sign values in place: sorted, stable (nodes come from one
+ * array, so equal values must keep increasing addresses) and tail kept
+ */
+void TEST_RADIXSORT()
+{
+    static struct node nodes[1000];
+    struct linked_list list;
+    struct node *p = NULL;
+    bool ok = true;
+    int i, len = 0;
+
+    list_init(&list);
+    for (i = 0; i < 1000; i++) {
+        nodes[i].data = i % 3 ? rand() % 21 - 10 : rand() - RAND_MAX / 2;
+        list_tadd(&list, &nodes[i]);
+    }
+    list_radixsort(&list);
+
+    for (p = list.head; p != NULL; p = p->next) {
+        len++;
+        if (p->next && (p->data > p->next->data ||
+                        (p->data == p->next->data && p > p->next)))
+            ok = false;
+        if (NULL == p->next && p != list.tail)
+            ok = false;
+    }
+    if (len != 1000 || list_length(&list) != 1000)
+        ok = false;
+
+    /* all equal: nothing to do */
+    list_init(&list);
+    for (i = 0; i < 10; i++) {
+        nodes[i].data = -7;
+        list_tadd(&list, &nodes[i]);
+    }
+    list_radixsort(&list);
+    if (list.head != &nodes[0] || list.tail != &nodes[9])
+        ok = false;
+
+    printf("%-28s", "TEST_RADIXSORT");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/*
+ * parallel merge sort with more, fewer and as many threads as nodes:
+ * sorted, stable and with the tail kept
+ */
+void TEST_MERGESORT_PARALLEL()
+{
+    static struct node nodes[5000];
+    static const int sizes[] = { 2, 3, 7, 64, 5000 };
+    static const int threads[] = { 1, 2, 3, 8, 100 };
+    struct linked_list list;
+    struct node *p = NULL;
+    bool ok = true;
+    int i, s, t, len;
+
+    for (s = 0; s < 5; s++) {
+        for (t = 0; t < 5; t++) {
+            list_init(&list);
+            for (i = 0; i < sizes[s]; i++) {
+                nodes[i].data = rand() % 50 - 25;
+                list_tadd(&list, &nodes[i]);
+            }
+            list_mergesort_parallel(&list, threads[t]);
+
+            len = 0;
+            for (p = list.head; p != NULL; p = p->next) {
+                len++;
+                if (p->next && (p->data > p->next->data ||
+                                (p->data == p->next->data && p > p->next)))
+                    ok = false;
+                if (NULL == p->next && p != list.tail)
+                    ok = false;
+            }
+            if (len != sizes[s] || list_length(&list) != sizes[s])
+                ok = false;
+        }
+    }
+
+    printf("%-28s", "TEST_MERGESORT_PARALLEL");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/*
+ * in-place quicksort on random, sorted, reversed, all-equal and organ-pipe
+ * input: sorted, stable, nodes only relinked and the tail kept
+ */
+void TEST_QUICKSORT_INPLACE()
+{
+    static struct node nodes[3000];
+    struct linked_list list;
+    struct node *p = NULL;
+    bool ok = true;
+    int i, k, n = 3000, len;
+
+    for (k = 0; k < 5; k++) {
+        list_init(&list);
+        for (i = 0; i < n; i++) {
+            switch (k) {
+            case 0: nodes[i].data = rand() % 100 - 50; break;
+            case 1: nodes[i].data = i; break;
+            case 2: nodes[i].data = n - i; break;
+            case 3: nodes[i].data = 42; break;
+            default: nodes[i].data = i < n / 2 ? i : n - i;
+            }
+            list_tadd(&list, &nodes[i]);
+        }
+        list_quicksort(&list);
+
+        len = 0;
+        for (p = list.head; p != NULL; p = p->next) {
+            len++;
+            if (p < nodes || p >= nodes + n)
+                ok = false;
+            if (p->next && (p->data > p->next->data ||
+                            (p->data == p->next->data && p > p->next)))
+                ok = false;
+            if (NULL == p->next && p != list.tail)
+                ok = false;
+        }
+        if (len != n || list_length(&list) != n)
+            ok = false;
+    }
 
-        printf("%-10d%-6d%-15.10f%-15.10f%-15.10f\n", n, i+1, ttm, ttq, ttm*1./ttq);
+    /* list_partition() moves the pivot in front, without allocating */
+    list_init(&list);
+    for (i = 0; i < 4; i++) {
+        nodes[i].data = (int[]){ 5, 9, 1, 7 }[i];
+        list_tadd(&list, &nodes[i]);
     }
+    p = list_partition(&list);
+    if (p->data != 5 || list.head->data != 1 || list.head->next != p ||
+        p->next->next != &nodes[3] || list.tail != &nodes[3] ||
+        list_length(&list) != 4)
+        ok = false;
+
+    printf("%-28s", "TEST_QUICKSORT_INPLACE");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/* a list of a[0..n-1] whose nodes lie in allocation order in a new pool */
+struct linked_list * make_pool_list(struct node_pool *pool, int a[], int n)
+{
+    struct linked_list *list =
+        (struct linked_list *)malloc(sizeof(struct linked_list));
+    int i;
+
+    node_pool_init(pool, 0);
+    list_init_pool(list, pool);
+    for (i = 0; i < n; i++)
+        list_append(list, a[i]);
+
+    return list;
+}
+
+/*
+ * list_mergesort_parallel() on <n> nodes with 1, 2, 4... threads, up to the
+ * number of online cores and at least 4, against list_mergesort2(). The
+ * speedup column only means something up to the number of cores. Nodes
+ * come from pools so that every sort starts from the same memory layout,
+ * not from whatever order the previous list was freed in.
+ */
+void compare_parallel(int n)
+{
+    int ncpu = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = ncpu > 4 ? ncpu : 4;
+    struct timespec t1, t2;
+    double tms, tp, t1p = 0;
+    int *a = NULL;
+    int t;
+
+    make_array(&a, n);
+
+    struct node_pool pool;
+    struct linked_list *list = make_pool_list(&pool, a, n);
+    current_utc_time(&t1);
+    list_mergesort2(&list);
+    current_utc_time(&t2);
+    tms = elapsed(&t1, &t2);
+    list_destroy_pool(list);
+
+    printf("%-10s%-6s%-9s%-15s%-15s%-15s\n", "Size", "Cores", "Threads",
+           "Time", "Speedup", "Ratio(MS2/PS)");
+    for (t = 1; t <= max_threads; t *= 2) {
+        list = make_pool_list(&pool, a, n);
+
+        current_utc_time(&t1);
+        list_mergesort_parallel(list, t);
+        current_utc_time(&t2);
+        tp = elapsed(&t1, &t2);
+        if (1 == t) t1p = tp;
+
+        printf("%-10d%-6d%-9d%-15.10f%-15.10f%-15.10f\n", n, ncpu, t, tp,
+               t1p / tp, tms / tp);
+        list_destroy_pool(list);
+    }
+    if (max_threads > ncpu)
+        printf("rows with more threads than the %d online core(s) measure "
+               "scheduling overhead, not speedup\n", ncpu);
+
+    free(a);
+}
+
+/*
+ * list_quicksort() against list_mergesort2() on <n> random, sorted,
+ * reversed and all-equal values, nodes laid out in order in a pool
+ */
+void compare_quicksort(int n)
+{
+    static const char *names[] = { "random", "sorted", "reversed", "equal" };
+    struct node_pool pool;
+    struct linked_list *list = NULL;
+    struct timespec t1, t2;
+    double tq, tm;
+    int *a = (int *)malloc(sizeof(int) * n);
+    int i, k;
+
+    printf("%-10s%-10s%-15s%-15s%-15s\n", "Size", "Input", "QS Time",
+           "MS2 Time", "Ratio(MS2/QS)");
+    for (k = 0; k < 4; k++) {
+        for (i = 0; i < n; i++)
+            a[i] = 0 == k ? rand() : (1 == k ? i : (2 == k ? n - i : 7));
+
+        list = make_pool_list(&pool, a, n);
+        current_utc_time(&t1);
+        list_quicksort(list);
+        current_utc_time(&t2);
+        tq = elapsed(&t1, &t2);
+        list_destroy_pool(list);
+
+        list = make_pool_list(&pool, a, n);
+        current_utc_time(&t1);
+        list_mergesort2(&list);
+        current_utc_time(&t2);
+        tm = elapsed(&t1, &t2);
+        list_destroy_pool(list);
+
+        printf("%-10d%-10s%-15.10f%-15.10f%-15.10f\n", n, names[k], tq, tm,
+               tm / tq);
+    }
+
+    free(a);
+}
+
+/* check every allocation site of list.h against a pool of tiny slabs */
+void TEST_POOL()
+{
+    struct node_pool pool;
+    struct linked_list *list =
+        (struct linked_list *)malloc(sizeof(struct linked_list));
+    struct node *p = NULL;
+    bool ok = true;
+    int i;
+
+    node_pool_init(&pool, 4);
+    list_init_pool(list, &pool);
+
+    for (i = 0; i < 20; i++)
+        list_append(list, 19 - i);
+    list_push(list, 100);
+    list_insert_nth(list, 5, 200);
+    if (list_pop(list) != 100 || list_length(list) != 21)
+        ok = false;
+    list_del(list, list_getitem(list, 0));
+
+    /* both sorts relink nodes, the list keeps its pool */
+    list_quicksort(list);
+    list_mergesort2(&list);
+    if (list->pool != &pool || list_length(list) != 20)
+        ok = false;
+    for (p = list->head; p && p->next; p = p->next)
+        if (p->data > p->next->data)
+            ok = false;
+
+    /* freed nodes are recycled before a new slab is carved up */
+    p = list_getitem(list, 3);
+    list_del(list, p);
+    list_append(list, 7);
+    if (list->tail != p)
+        ok = false;
+
+    list_destroy_pool(list);
+    if (pool.slabs != NULL || pool.free != NULL)
+        ok = false;
+
+    printf("%-28s", "TEST_POOL");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/*
+ * append, traverse and destroy <n> nodes from a pool and from malloc. Run
+ * it on a fresh heap: the first slab allocated after millions of small
+ * free()s would otherwise pay for glibc consolidating all of them.
+ */
+void compare_pool(int n)
+{
+    struct node_pool pool;
+    struct timespec t1, t2;
+    double ta[2], tt[2], td[2];
+    long sum[2] = { 0, 0 };
+    int i, k;
+
+    node_pool_init(&pool, 0);
+    for (k = 0; k < 2; k++) {
+        struct linked_list *list =
+            (struct linked_list *)malloc(sizeof(struct linked_list));
+        struct node *p = NULL;
+
+        if (k) list_init(list);
+        else list_init_pool(list, &pool);
+
+        current_utc_time(&t1);
+        for (i = 0; i < n; i++)
+            list_append(list, i);
+        current_utc_time(&t2);
+        ta[k] = elapsed(&t1, &t2);
+
+        current_utc_time(&t1);
+        for (p = list->head; p != NULL; p = p->next)
+            sum[k] += p->data;
+        current_utc_time(&t2);
+        tt[k] = elapsed(&t1, &t2);
+
+        current_utc_time(&t1);
+        if (k) list_destroy(list);
+        else list_destroy_pool(list);
+        current_utc_time(&t2);
+        td[k] = elapsed(&t1, &t2);
+    }
+
+    printf("%-10s%-8s%-15s%-15s%-15s\n", "Size", "Nodes", "Append", "Traverse",
+           "Destroy");
+    printf("%-10d%-8s%-15.10f%-15.10f%-15.10f\n", n, "malloc", ta[1], tt[1], td[1]);
+    printf("%-10d%-8s%-15.10f%-15.10f%-15.10f\n", n, "pool", ta[0], tt[0], td[0]);
+    if (sum[0] != sum[1])
+        printf(KRED "traversals disagree\n" RESET);
 }
 
 void TEST_INSERTIONSORT()
@@ -340,6 +702,13 @@ int main(int argc, char **argv)
     }
 
     //printf("%lu, %lu\n", sizeof(void *), sizeof(struct node));
+    TEST_POOL();
+    TEST_RADIXSORT();
+    TEST_MERGESORT_PARALLEL();
+    TEST_QUICKSORT_INPLACE();
+    compare_pool(atoi(argv[1]));
+    compare_parallel(atoi(argv[1]));
+    compare_quicksort(atoi(argv[1]));
     compare_sort(atoi(argv[1]), atoi(argv[2]));
 
     return 0;
@@ -0,0 +1,325 @@
+#ifndef __LIST_UNROLLED_H
+#define __LIST_UNROLLED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+
+/*
+ * unrolled single linked list of ints
+ *
+ * Each node (block) is one cache line holding up to ULIST_BLOCK_INTS values,
+ * so walking the list takes one cache miss per ULIST_BLOCK_INTS elements
+ * instead of one per element, and the next pointer is paid once per block.
+ * Blocks other than the last one are kept at least half full: inserting
+ * into a full block splits it, and a deletion that leaves a block less
+ * than half full refills it from the next block or merges the two.
+ */
+
+#define ULIST_BLOCK_SIZE 64
+#define ULIST_BLOCK_INTS \
+    ((ULIST_BLOCK_SIZE - sizeof(void *) - sizeof(int)) / sizeof(int))
+#define ULIST_MIN_INTS (ULIST_BLOCK_INTS / 2)
+
+struct ublock
+{
+    struct ublock *next;
+    int count; /* values used in data[] */
+    int data[ULIST_BLOCK_INTS];
+} __attribute__((aligned(ULIST_BLOCK_SIZE)));
+
+struct unrolled_list
+{
+    struct ublock *head; /* first block */
+    struct ublock *tail; /* last block */
+    int len; /* number of values */
+    int nblocks; /* number of blocks */
+};
+
+/*
+ * ulist_for_each - iterate over the values of an unrolled list
+ * @list: the list
+ * @b: the struct ublock * to use as a block cursor
+ * @i: int to use as the index into @b->data
+ */
+#define ulist_for_each(list, b, i) \
+    for ((b) = (list)->head; (b) != NULL; (b) = (b)->next) \
+        for ((i) = 0; (i) < (b)->count; (i)++)
+
+void ulist_init(struct unrolled_list *list)
+{
+    list->head = NULL;
+    list->tail = NULL;
+    list->len = 0;
+    list->nblocks = 0;
+}
+
+bool ulist_is_empty(struct unrolled_list *list)
+{
+    return 0 == list->len;
+}
+
+int ulist_length(struct unrolled_list *list)
+{
+    assert(list->len >= 0);
+    return list->len;
+}
+
+/*
+ * allocate an empty block and link it after @prev, or at the head when
+ * @prev is NULL
+ */
+struct ublock * __ulist_new_block(struct unrolled_list *list,
+        struct ublock *prev)
+{
+    struct ublock *b = (struct ublock *)aligned_alloc(ULIST_BLOCK_SIZE,
+            sizeof(struct ublock));
+    if (NULL == b) return NULL;
+
+    b->count = 0;
+    if (prev) {
+        b->next = prev->next;
+        prev->next = b;
+    } else {
+        b->next = list->head;
+        list->head = b;
+    }
+    if (NULL == b->next) list->tail = b;
+    list->nblocks++;
+
+    return b;
+}
+
+/*
+ * unlink and free block @b, @prev is the block before it or NULL
+ */
+void __ulist_free_block(struct unrolled_list *list, struct ublock *prev,
+        struct ublock *b)
+{
+    if (prev) prev->next = b->next;
+    else list->head = b->next;
+    if (list->tail == b) list->tail = prev;
+    list->nblocks--;
+    free(b);
+}
+
+/*
+ * find the block holding index @idx, with *@off set to the index inside
+ * it and *@prev to the block before it
+ * Time Complexity: O(n / ULIST_BLOCK_INTS)
+ */
+struct ublock * __ulist_find(struct unrolled_list *list, int idx, int *off,
+        struct ublock **prev)
+{
+    struct ublock *b = list->head, *p = NULL;
+
+    while (b && idx >= b->count) {
+        idx -= b->count;
+        p = b;
+        b = b->next;
+    }
+
+    *off = idx;
+    if (prev) *prev = p;
+    return b;
+}
+
+/*
+ * append a value to the tail of the list
+ * Time Complexity: O(1)
+ */
+void ulist_append(struct unrolled_list *list, int value)
+{
+    struct ublock *b = list->tail;
+
+    if (NULL == b || b->count == (int)ULIST_BLOCK_INTS) {
+        b = __ulist_new_block(list, list->tail);
+        if (NULL == b) return;
+    }
+
+    b->data[b->count++] = value;
+    list->len++;
+}
+
+/*
+ * insert value so that it ends up at index idx, idx range is
+ * [0, list_length()]; do nothing when index is illegal
+ * Time Complexity: O(n / ULIST_BLOCK_INTS)
+ */
+void ulist_insert_nth(struct unrolled_list *list, int idx, int value)
+{
+    struct ublock *b, *nb;
+    int off, half;
+
+    if (idx < 0 || idx > list->len) return;
+    if (idx == list->len) {
+        ulist_append(list, value);
+        return;
+    }
+
+    b = __ulist_find(list, idx, &off, NULL);
+
+    /* split a full block, moving its upper half to a new block after it */
+    if (b->count == (int)ULIST_BLOCK_INTS) {
+        nb = __ulist_new_block(list, b);
+        if (NULL == nb) return;
+
+        half = b->count / 2;
+        nb->count = b->count - half;
+        memcpy(nb->data, b->data + half, sizeof(int) * nb->count);
+        b->count = half;
+        if (off > half) {
+            off -= half;
+            b = nb;
+        }
+    }
+
+    memmove(b->data + off + 1, b->data + off, sizeof(int) * (b->count - off));
+    b->data[off] = value;
+    b->count++;
+    list->len++;
+}
+
+/*
+ * delete the value at index idx, do nothing when index is illegal
+ * Time Complexity: O(n / ULIST_BLOCK_INTS)
+ */
+void ulist_del(struct unrolled_list *list, int idx)
+{
+    struct ublock *b, *prev, *nb;
+    int off, n;
+
+    if (idx < 0 || idx >= list->len) return;
+
+    b = __ulist_find(list, idx, &off, &prev);
+    memmove(b->data + off, b->data + off + 1,
+            sizeof(int) * (b->count - off - 1));
+    b->count--;
+    list->len--;
+
+    if (0 == b->count) {
+        __ulist_free_block(list, prev, b);
+        return;
+    }
+    if (b->count >= (int)ULIST_MIN_INTS || NULL == (nb = b->next)) return;
+
+    /* underfull: merge with the next block if both fit, else borrow from it */
+    if (b->count + nb->count <= (int)ULIST_BLOCK_INTS) {
+        memcpy(b->data + b->count, nb->data, sizeof(int) * nb->count);
+        b->count += nb->count;
+        __ulist_free_block(list, b, nb);
+    } else {
+        n = (nb->count - b->count) / 2;
+        memcpy(b->data + b->count, nb->data, sizeof(int) * n);
+        memmove(nb->data, nb->data + n, sizeof(int) * (nb->count - n));
+        b->count += n;
+        nb->count -= n;
+    }
+}
+
+/*
+ * get the number of occurrences of value in the list
+ * Time Complexity: O(n)
+ */
+int ulist_count(struct unrolled_list *list, int value)
+{
+    struct ublock *b;
+    int i, cnt = 0;
+
+    ulist_for_each(list, b, i)
+        cnt += b->data[i] == value;
+
+    return cnt;
+}
+
+/*
+ * return the address of the value indexed by "index", index range is
+ * [0, list_length()-1], NULL when out of range
+ * Time Complexity: O(n / ULIST_BLOCK_INTS)
+ */
+int * ulist_getitem(struct unrolled_list *list, int index)
+{
+    struct ublock *b;
+    int off;
+
+    if (index < 0 || index >= list->len) return NULL;
+
+    b = __ulist_find(list, index, &off, NULL);
+    return &b->data[off];
+}
+
+/*
+ * deallocate all blocks and set it to the empty list, the list structure
+ * itself is left to the caller
+ */
+void ulist_destroy(struct unrolled_list *list)
+{
+    struct ublock *b = list->head, *next = NULL;
+
+    while (b) {
+        next = b->next;
+        free(b);
+        b = next;
+    }
+
+    ulist_init(list);
+}
+
+int __ulist_cmp(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * sort the list: the values are gathered into an array, sorted and written
+ * back packed, ULIST_BLOCK_INTS per block, and the blocks left over are freed
+ * Time Complexity: O(n log n)
+ * Space Complexity: O(n)
+ */
+void ulist_sort(struct unrolled_list *list)
+{
+    struct ublock *b, *prev = NULL;
+    int *a, i, k = 0;
+
+    if (list->len < 2) return;
+
+    a = (int *)malloc(sizeof(int) * list->len);
+    if (NULL == a) return;
+
+    ulist_for_each(list, b, i)
+        a[k++] = b->data[i];
+    qsort(a, list->len, sizeof(int), __ulist_cmp);
+
+    for (b = list->head, k = 0; k < list->len; prev = b, b = b->next) {
+        b->count = list->len - k < (int)ULIST_BLOCK_INTS ?
+            list->len - k : (int)ULIST_BLOCK_INTS;
+        memcpy(b->data, a + k, sizeof(int) * b->count);
+        k += b->count;
+    }
+    while (prev->next)
+        __ulist_free_block(list, prev, prev->next);
+
+    free(a);
+}
+
+void ulist_disp(struct unrolled_list *list)
+{
+    struct ublock *b;
+    int i;
+
+    for (b = list->head; b != NULL; b = b->next) {
+        printf("[");
+        for (i = 0; i < b->count; i++)
+            printf(i ? " %d" : "%d", b->data[i]);
+        printf("]");
+        if (NULL != b->next) printf(" -> ");
+    }
+
+    printf("\n");
+}
+
+#endif
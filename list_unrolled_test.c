@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+
+#include "list.h"
+#include "list_unrolled.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* blocks are within bounds, all but the last at least half full */
+static bool check_blocks(struct unrolled_list *list)
+{
+    struct ublock *b, *last = NULL;
+    int len = 0, nblocks = 0;
+
+    for (b = list->head; b != NULL; last = b, b = b->next) {
+        if (b->count < 1 || b->count > (int)ULIST_BLOCK_INTS)
+            return false;
+        if (b->next && b->count < (int)ULIST_MIN_INTS)
+            return false;
+        len += b->count;
+        nblocks++;
+    }
+
+    return len == list->len && nblocks == list->nblocks && last == list->tail;
+}
+
+/* random inserts, deletes and appends replayed on a plain array */
+void TEST_ULIST()
+{
+    static int model[20000];
+    struct unrolled_list list;
+    struct ublock *b;
+    int i, j, n = 0, idx, v;
+    bool ok = true;
+
+    ulist_init(&list);
+    for (i = 0; i < 40000; i++) {
+        v = rand() % 100;
+        switch (n < 10000 ? rand() % 3 : 2) {
+        case 0:
+            ulist_append(&list, v);
+            model[n++] = v;
+            break;
+        case 1:
+            idx = rand() % (n + 1);
+            ulist_insert_nth(&list, idx, v);
+            memmove(model + idx + 1, model + idx, sizeof(int) * (n - idx));
+            model[idx] = v;
+            n++;
+            break;
+        default:
+            if (0 == n)
+                break;
+            idx = rand() % n;
+            ulist_del(&list, idx);
+            memmove(model + idx, model + idx + 1, sizeof(int) * (n - idx - 1));
+            n--;
+        }
+        if (i % 1000 == 0 && !check_blocks(&list))
+            ok = false;
+    }
+
+    if (!check_blocks(&list) || ulist_length(&list) != n)
+        ok = false;
+    j = 0;
+    ulist_for_each(&list, b, i)
+        if (b->data[i] != model[j++])
+            ok = false;
+    for (i = 0; i < n; i += 7)
+        if (*ulist_getitem(&list, i) != model[i])
+            ok = false;
+    if (ulist_getitem(&list, n) || ulist_count(&list, model[0]) < 1)
+        ok = false;
+
+    ulist_sort(&list);
+    if (!check_blocks(&list) || list.nblocks !=
+            (n + (int)ULIST_BLOCK_INTS - 1) / (int)ULIST_BLOCK_INTS)
+        ok = false;
+    for (i = 1; i < n; i++)
+        if (*ulist_getitem(&list, i - 1) > *ulist_getitem(&list, i))
+            ok = false;
+
+    ulist_destroy(&list);
+    if (!ulist_is_empty(&list) || list.head != NULL)
+        ok = false;
+
+    printf("%-28s", "TEST_ULIST");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/*
+ * Build both lists with <n> appends, then time full traversals (count),
+ * and <m> random getitem, insert_nth and delete operations.
+ */
+void compare_unrolled(int n, int m)
+{
+    struct linked_list *list =
+        (struct linked_list *)malloc(sizeof(struct linked_list));
+    struct unrolled_list ulist;
+    double t[2][5];
+    int *idx = (int *)malloc(sizeof(int) * m);
+    long sum[2] = { 0, 0 };
+    int i, k;
+
+    for (i = 0; i < m; i++)
+        idx[i] = rand() % n;
+
+    list_init(list);
+    ulist_init(&ulist);
+    for (k = 0; k < 2; k++) {
+        t[k][0] = now();
+        for (i = 0; i < n; i++) {
+            if (k) ulist_append(&ulist, i % 1000);
+            else list_append(list, i % 1000);
+        }
+        t[k][0] = now() - t[k][0];
+    }
+
+    for (k = 0; k < 2; k++) {
+        t[k][1] = now();
+        for (i = 0; i < 10; i++)
+            sum[k] += k ? ulist_count(&ulist, i) : list_count(list, i);
+        t[k][1] = (now() - t[k][1]) / 10;
+
+        t[k][2] = now();
+        for (i = 0; i < m; i++)
+            sum[k] += k ? *ulist_getitem(&ulist, idx[i])
+                        : list_getitem(list, idx[i])->data;
+        t[k][2] = now() - t[k][2];
+
+        t[k][3] = now();
+        for (i = 0; i < m; i++) {
+            if (k) ulist_insert_nth(&ulist, idx[i], i);
+            else list_insert_nth(list, idx[i], i);
+        }
+        t[k][3] = now() - t[k][3];
+
+        t[k][4] = now();
+        for (i = 0; i < m; i++) {
+            if (k) ulist_del(&ulist, idx[i]);
+            else list_del(list, list_getitem(list, idx[i]));
+        }
+        t[k][4] = now() - t[k][4];
+    }
+
+    printf("%-10s%-10s%-13s%-13s%-13s%-13s%-13s%-10s\n", "Size", "List",
+           "Append(ms)", "Count(ms)", "Getitem(us)", "Insert(us)",
+           "Delete(us)", "B/value");
+    printf("%-10d%-10s%-13.2f%-13.2f%-13.2f%-13.2f%-13.2f%-10.1f\n", n,
+           "linked", t[0][0] * 1e3, t[0][1] * 1e3, t[0][2] * 1e6 / m,
+           t[0][3] * 1e6 / m, t[0][4] * 1e6 / m, (double)sizeof(struct node));
+    printf("%-10d%-10s%-13.2f%-13.2f%-13.2f%-13.2f%-13.2f%-10.1f\n", n,
+           "unrolled", t[1][0] * 1e3, t[1][1] * 1e3, t[1][2] * 1e6 / m,
+           t[1][3] * 1e6 / m, t[1][4] * 1e6 / m,
+           (double)sizeof(struct ublock) * ulist.nblocks / ulist.len);
+    if (sum[0] != sum[1])
+        printf(KRED "lists disagree\n" RESET);
+
+    list_destroy(list);
+    ulist_destroy(&ulist);
+    free(idx);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <num> <nops>\n", argv[0]);
+        exit(1);
+    }
+
+    srand((unsigned)time(0));
+    TEST_ULIST();
+    compare_unrolled(atoi(argv[1]), atoi(argv[2]));
+
+    return 0;
+}
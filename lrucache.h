@@ -0,0 +1,246 @@
+#ifndef __LRUCACHE_H__
+#define __LRUCACHE_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "hash.h"
+#include "rhashtable.h"
+#include "sys-queue.h"
+
+/*
+ * Intrusive LRU cache.
+ *
+ * Objects embed a struct lru_node, which links them into a resizable
+ * hashtable (rhashtable.h) for lookups and into a TAILQ (sys-queue.h)
+ * ordered by recency, most recently used first. The TAILQ is doubly
+ * linked, so unlinking a node to promote or evict it is O(1); the
+ * singly linked list_generic.h has to walk the whole ring to find a
+ * node's predecessor.
+ *
+ * Capacity is a number of entries, a total charge (bytes, or any other
+ * unit the caller picks per entry), or both; 0 means no limit. Adding an
+ * entry evicts from the cold end until both limits hold again, handing
+ * every evicted node to the eviction callback, which typically frees the
+ * object. The cache never allocates or frees objects itself.
+ */
+
+struct lru_node
+{
+	struct hlist_node hnode;
+	TAILQ_ENTRY(lru_node) lru;
+	uint64_t key;
+	size_t charge;
+};
+
+TAILQ_HEAD(lru_list, lru_node);
+
+typedef void (*lru_evict_fn)(struct lru_node *node, void *arg);
+
+struct lru_cache
+{
+	struct rhashtable ht;
+	struct lru_list list;		/* hottest first */
+	unsigned long max_count;	/* 0 for no limit */
+	size_t max_charge;		/* 0 for no limit */
+	size_t charge;
+	lru_evict_fn evict;
+	void *arg;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+};
+
+static inline uint64_t __lru_hashfn(const struct hlist_node *node)
+{
+	return hlist_entry(node, struct lru_node, hnode)->key;
+}
+
+/**
+ * lru_init - initialize an LRU cache
+ * @c: the cache to initialize
+ * @max_count: most entries the cache holds, 0 for no limit
+ * @max_charge: largest total charge the cache holds, 0 for no limit
+ * @evict: called on each node evicted to make room, may be NULL
+ * @arg: passed to @evict
+ *
+ * Returns 0 on success and -ENOMEM if the hashtable can't be allocated.
+ */
+static inline int lru_init(struct lru_cache *c, unsigned long max_count,
+			   size_t max_charge, lru_evict_fn evict, void *arg)
+{
+	if (rhash_init(&c->ht, RHASH_MIN_BITS, __lru_hashfn))
+		return -ENOMEM;
+
+	TAILQ_INIT(&c->list);
+	c->max_count = max_count;
+	c->max_charge = max_charge;
+	c->charge = 0;
+	c->evict = evict;
+	c->arg = arg;
+	c->hits = c->misses = c->evictions = 0;
+
+	return 0;
+}
+
+static inline unsigned long lru_count(const struct lru_cache *c)
+{
+	return rhash_count(&c->ht);
+}
+
+static inline size_t lru_charge(const struct lru_cache *c)
+{
+	return c->charge;
+}
+
+/* fraction of lru_get() calls that found their key */
+static inline double lru_hit_ratio(const struct lru_cache *c)
+{
+	unsigned long total = c->hits + c->misses;
+
+	return total ? (double)c->hits / total : 0;
+}
+
+static inline struct lru_node *__lru_find(struct lru_cache *c, uint64_t key)
+{
+	struct lru_node *node;
+
+	rhash_for_each_possible(&c->ht, node, hnode, key) {
+		if (node->key == key)
+			return node;
+	}
+
+	return NULL;
+}
+
+/**
+ * lru_del - remove a node from an LRU cache
+ * @c: the cache to remove from
+ * @node: a node currently in @c
+ *
+ * The eviction callback is not called.
+ */
+static inline void lru_del(struct lru_cache *c, struct lru_node *node)
+{
+	rhash_del(&c->ht, &node->hnode);
+	TAILQ_REMOVE(&c->list, node, lru);
+	c->charge -= node->charge;
+}
+
+/**
+ * lru_evict - evict the least recently used node
+ * @c: the cache to evict from
+ *
+ * Returns false if @c was empty.
+ */
+static inline bool lru_evict(struct lru_cache *c)
+{
+	struct lru_node *node = TAILQ_LAST(&c->list, lru_list);
+
+	if (!node)
+		return false;
+
+	lru_del(c, node);
+	c->evictions++;
+	if (c->evict)
+		c->evict(node, c->arg);
+	return true;
+}
+
+static inline bool __lru_over(const struct lru_cache *c)
+{
+	return (c->max_count && lru_count(c) > c->max_count) ||
+	       (c->max_charge && c->charge > c->max_charge);
+}
+
+/**
+ * lru_destroy - evict every node and release the hashtable
+ * @c: the cache to destroy
+ *
+ * Each remaining node goes to the eviction callback, coldest first.
+ */
+static inline void lru_destroy(struct lru_cache *c)
+{
+	while (lru_evict(c))
+		;
+	rhash_destroy(&c->ht);
+}
+
+/**
+ * lru_peek - find a node without touching its recency or the statistics
+ * @c: the cache to search
+ * @key: the key to look up
+ */
+static inline struct lru_node *lru_peek(struct lru_cache *c, uint64_t key)
+{
+	return __lru_find(c, key);
+}
+
+/**
+ * lru_get - find a node and mark it most recently used
+ * @c: the cache to search
+ * @key: the key to look up
+ *
+ * Returns the node, or NULL on a miss.
+ */
+static inline struct lru_node *lru_get(struct lru_cache *c, uint64_t key)
+{
+	struct lru_node *node = __lru_find(c, key);
+
+	if (!node) {
+		c->misses++;
+		return NULL;
+	}
+
+	c->hits++;
+	if (node != TAILQ_FIRST(&c->list)) {
+		TAILQ_REMOVE(&c->list, node, lru);
+		TAILQ_INSERT_HEAD(&c->list, node, lru);
+	}
+	return node;
+}
+
+/**
+ * lru_add - insert a node as the most recently used entry
+ * @c: the cache to add to
+ * @node: the node of the object to add
+ * @key: the key of the object
+ * @charge: what the object counts against the charge limit
+ *
+ * Evicts the coldest entries until the cache is within its limits again.
+ * Returns 0 on success, -EEXIST if @key is already cached and -E2BIG if
+ * @charge alone exceeds the charge limit; @node isn't added on failure.
+ */
+static inline int lru_add(struct lru_cache *c, struct lru_node *node,
+			  uint64_t key, size_t charge)
+{
+	if (c->max_charge && charge > c->max_charge)
+		return -E2BIG;
+	if (__lru_find(c, key))
+		return -EEXIST;
+
+	node->key = key;
+	node->charge = charge;
+	rhash_add(&c->ht, &node->hnode);
+	TAILQ_INSERT_HEAD(&c->list, node, lru);
+	c->charge += charge;
+
+	while (__lru_over(c))
+		lru_evict(c);
+
+	return 0;
+}
+
+/**
+ * lru_for_each - iterate over an LRU cache from hottest to coldest
+ * @c: the &struct lru_cache to iterate
+ * @node: the struct lru_node * to use as a loop cursor
+ *
+ * The cache must not be modified during the walk.
+ */
+#define lru_for_each(c, node)						\
+	TAILQ_FOREACH(node, &(c)->list, lru)
+
+#endif /* __LRUCACHE_H__ */
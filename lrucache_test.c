@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lrucache.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+struct item
+{
+    struct lru_node node;
+    int evicted;
+    char payload[48];
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void mark_evicted(struct lru_node *node, void *arg)
+{
+    struct item *it = container_of(node, struct item, node);
+
+    it->evicted = ++*(int *)arg;
+}
+
+void TEST_LRU()
+{
+    static struct item items[200];
+    struct lru_node *node;
+    struct lru_cache c;
+    int i, order = 0;
+    bool ok = true;
+
+    for (i = 0; i < 200; i++)
+        items[i].evicted = 0;
+
+    /* count limit: the 36 oldest go, in insertion order */
+    if (lru_init(&c, 64, 0, mark_evicted, &order)) {
+        printf("%-28s" KRED "\tFAILED\n" RESET, "TEST_LRU");
+        return;
+    }
+    for (i = 0; i < 100; i++)
+        if (lru_add(&c, &items[i].node, i, 1))
+            ok = false;
+    for (i = 0; i < 100; i++)
+        if (items[i].evicted != (i < 36 ? i + 1 : 0))
+            ok = false;
+    if (lru_count(&c) != 64 || lru_peek(&c, 35) || !lru_peek(&c, 36))
+        ok = false;
+    if (lru_add(&c, &items[150].node, 50, 1) != -EEXIST)
+        ok = false;
+
+    /* a hit protects 36 from the next eviction, which takes 37 instead */
+    if (lru_get(&c, 36) != &items[36].node || lru_get(&c, 1000))
+        ok = false;
+    lru_add(&c, &items[100].node, 100, 1);
+    if (items[36].evicted || items[37].evicted != 37)
+        ok = false;
+    if (c.hits != 1 || c.misses != 1 || c.evictions != 37)
+        ok = false;
+
+    i = 0;
+    lru_for_each(&c, node) {
+        if (i == 0 && node != &items[100].node)
+            ok = false;
+        if (i == 1 && node != &items[36].node)
+            ok = false;
+        i++;
+    }
+    if (i != 64)
+        ok = false;
+
+    /* lru_del() doesn't call back, lru_destroy() hands over the rest */
+    lru_del(&c, &items[99].node);
+    lru_destroy(&c);
+    if (items[99].evicted || order != 37 + 63)
+        ok = false;
+
+    /* charge limit */
+    order = 0;
+    for (i = 0; i < 200; i++)
+        items[i].evicted = 0;
+    if (lru_init(&c, 0, 1000, mark_evicted, &order)) {
+        ok = false;
+    } else {
+        for (i = 0; i < 10; i++)
+            lru_add(&c, &items[i].node, i, 100);
+        if (lru_add(&c, &items[10].node, 10, 1001) != -E2BIG)
+            ok = false;
+        lru_add(&c, &items[10].node, 10, 250);
+        if (lru_charge(&c) != 950 || lru_count(&c) != 8 || order != 3)
+            ok = false;
+        lru_destroy(&c);
+    }
+
+    printf("%-28s", "TEST_LRU");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/* freed objects go back onto a stack for the next miss */
+struct pool
+{
+    struct item **free;
+    int n;
+};
+
+static void release(struct lru_node *node, void *arg)
+{
+    struct pool *p = (struct pool *)arg;
+
+    p->free[p->n++] = container_of(node, struct item, node);
+}
+
+/*
+ * Zipf-distributed keys over [0, @range) with exponent 1, so weights are
+ * 1 / (k + 1) and need no libm, drawn from a precomputed CDF.
+ */
+static uint64_t *zipf_keys(unsigned long range, int nops)
+{
+    double *cdf = (double *)malloc(sizeof(double) * range);
+    uint64_t *keys = (uint64_t *)malloc(sizeof(uint64_t) * nops);
+    double sum = 0, u;
+    unsigned long lo, hi, mid, k;
+    int i;
+
+    for (k = 0; k < range; k++)
+        cdf[k] = sum += 1.0 / (k + 1);
+    for (i = 0; i < nops; i++) {
+        u = (double)rand() / RAND_MAX * sum;
+        for (lo = 0, hi = range - 1; lo < hi;) {
+            mid = (lo + hi) / 2;
+            if (cdf[mid] < u)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        /* scatter popular keys over the hashtable */
+        keys[i] = lo * 0x9e3779b97f4a7c15ULL;
+    }
+
+    free(cdf);
+    return keys;
+}
+
+/*
+ * Read-through workload: look a key up and, on a miss, fill the cache
+ * from a pool of objects that evictions return to.
+ */
+void compare_capacity(unsigned long range, int nops)
+{
+    static const double fractions[] = { 0.001, 0.01, 0.1, 0.5 };
+    uint64_t *keys = zipf_keys(range, nops);
+    struct item *items;
+    struct lru_cache c;
+    struct pool p;
+    unsigned long cap;
+    unsigned int f;
+    double t;
+    int i;
+
+    printf("%-10s%-12s%-12s%-12s\n", "Keys", "Capacity", "Hit ratio",
+           "Mops/s");
+    for (f = 0; f < ARRAY_SIZE(fractions); f++) {
+        cap = range * fractions[f];
+        items = (struct item *)malloc(sizeof(struct item) * (cap + 1));
+        p.free = (struct item **)malloc(sizeof(struct item *) * (cap + 1));
+        for (p.n = 0; p.n <= (int)cap; p.n++)
+            p.free[p.n] = &items[p.n];
+        if (lru_init(&c, cap, 0, release, &p)) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+
+        t = now();
+        for (i = 0; i < nops; i++) {
+            if (!lru_get(&c, keys[i]))
+                lru_add(&c, &p.free[--p.n]->node, keys[i],
+                        sizeof(struct item));
+        }
+        t = now() - t;
+
+        printf("%-10lu%-12lu%-12.4f%-12.2f\n", range, cap, lru_hit_ratio(&c),
+               nops / t / 1e6);
+        lru_destroy(&c);
+        free(p.free);
+        free(items);
+    }
+
+    free(keys);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <nkeys> <nops>\n", argv[0]);
+        exit(1);
+    }
+
+    srand((unsigned)time(0));
+    TEST_LRU();
+    compare_capacity(strtoul(argv[1], NULL, 0), atoi(argv[2]));
+
+    return 0;
+}
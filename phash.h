@@ -0,0 +1,484 @@
+#ifndef __PHASH_H__
+#define __PHASH_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hashtable.h"
+
+/*
+ * Frozen minimal perfect hash tables (CHD: "Hash, displace, and compress",
+ * Belazzougui, Botelho & Dietzfelbinger, ESA 2009).
+ *
+ * phash_freeze() takes a populated DEFINE_HASHTABLE() table and builds an
+ * immutable table with exactly one slot per key. Keys are spread over
+ * n / PHASH_LAMBDA buckets; the buckets are placed largest first, each
+ * trying displacement values until all of its keys land in free slots,
+ * and the displacement is all a bucket stores. Single-key buckets, which
+ * would need the longest searches at the end, are given a free slot
+ * directly, flagged with the top bit of the displacement. A lookup reads
+ * the displacement of its bucket and then one slot, whose key is compared
+ * to reject keys that were never in the table.
+ *
+ * The whole table is one flat block: a header, the displacement array and
+ * the slot array, all addressed by offsets. phash_save() writes it to a
+ * file and phash_map() maps such a file read-only for immediate use.
+ * Values are 64-bit integers; a table frozen with phash_freeze() stores
+ * object pointers, which only mean something in the process that froze it,
+ * so tables meant for files should be frozen with phash_freeze_field().
+ */
+
+#define PHASH_MAGIC		0x4853414850ULL		/* "PHASH" */
+#define PHASH_VERSION		1
+#define PHASH_LAMBDA		4	/* average keys per bucket */
+#define PHASH_MAX_DISP		(1U << 24)
+#define PHASH_MAX_SEEDS		16
+#define PHASH_DIRECT		0x80000000U	/* disp holds the slot itself */
+
+struct phash_entry
+{
+	uint64_t key;
+	uint64_t val;
+};
+
+struct phash_header
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t nbuckets;
+	uint64_t nkeys;			/* == number of slots */
+	uint64_t seed;
+	uint64_t disp_off;		/* byte offsets from the header */
+	uint64_t slots_off;
+	uint64_t size;			/* bytes in the whole image */
+	uint64_t reserved;
+};
+
+struct phash
+{
+	struct phash_header *hdr;
+	const uint32_t *disp;
+	const struct phash_entry *slots;
+	bool mapped;
+};
+
+/* multiply-shift range reduction, no division on the lookup path */
+static inline uint64_t __phash_reduce(uint64_t h, uint64_t n)
+{
+	return (uint64_t)(((unsigned __int128)h * n) >> 64);
+}
+
+static inline uint64_t __phash_hash(uint64_t key, uint64_t seed)
+{
+	return __hash_mix(key ^ seed, 0x9e3779b97f4a7c15ULL);
+}
+
+static inline uint64_t __phash_slot(uint64_t h, uint32_t d, uint64_t nslots)
+{
+	if (d & PHASH_DIRECT)
+		return d & ~PHASH_DIRECT;
+
+	return __phash_reduce(__hash_mix(h, d + 0xa0761d6478bd642fULL), nslots);
+}
+
+static inline void __phash_setup(struct phash *ph, void *base)
+{
+	ph->hdr = (struct phash_header *)base;
+	ph->disp = (const uint32_t *)((char *)base + ph->hdr->disp_off);
+	ph->slots = (const struct phash_entry *)((char *)base +
+						 ph->hdr->slots_off);
+}
+
+static inline unsigned long phash_count(const struct phash *ph)
+{
+	return ph->hdr->nkeys;
+}
+
+/**
+ * phash_lookup - find the entry stored under @key
+ * @ph: the frozen table to search
+ * @key: the key to look up
+ *
+ * Returns the entry, or NULL if @key wasn't in the table when it was frozen.
+ */
+static inline const struct phash_entry *phash_lookup(const struct phash *ph,
+						     uint64_t key)
+{
+	const struct phash_header *hdr = ph->hdr;
+	uint64_t h = __phash_hash(key, hdr->seed);
+	const struct phash_entry *e;
+
+	if (!hdr->nkeys)
+		return NULL;
+
+	e = &ph->slots[__phash_slot(h, ph->disp[__phash_reduce(h, hdr->nbuckets)],
+				    hdr->nkeys)];
+	return e->key == key ? e : NULL;
+}
+
+/*
+ * Place every bucket with one seed. Returns 0, -EAGAIN if some bucket ran
+ * out of displacements (try another seed) or -EEXIST on duplicate keys.
+ */
+static inline int __phash_place(struct phash_header *hdr, uint32_t *disp,
+				struct phash_entry *slots, const uint64_t *keys,
+				const uint64_t *vals, uint64_t *hashes,
+				uint32_t *order, uint32_t *start,
+				uint8_t *taken, uint64_t *pos)
+{
+	uint64_t n = hdr->nkeys, m = hdr->nkeys, free_slot = 0;
+	uint32_t nb = hdr->nbuckets, b, i, j, k, size, maxsize = 0, d;
+	uint32_t *bysize;
+
+	memset(start, 0, sizeof(uint32_t) * (nb + 1));
+	memset(taken, 0, m);
+	memset(disp, 0, sizeof(uint32_t) * nb);
+
+	/* counting sort of the keys by bucket */
+	for (i = 0; i < n; i++) {
+		hashes[i] = __phash_hash(keys[i], hdr->seed);
+		start[__phash_reduce(hashes[i], nb) + 1]++;
+	}
+	for (b = 0; b < nb; b++) {
+		if (start[b + 1] > maxsize)
+			maxsize = start[b + 1];
+		start[b + 1] += start[b];
+	}
+	for (i = 0; i < n; i++) {
+		b = __phash_reduce(hashes[i], nb);
+		order[start[b] + (uint32_t)pos[b]++] = i;
+	}
+
+	/* then of the buckets by size, largest first */
+	bysize = (uint32_t *)calloc(maxsize + 2, sizeof(uint32_t));
+	if (!bysize)
+		return -ENOMEM;
+	for (b = 0; b < nb; b++)
+		bysize[maxsize - (start[b + 1] - start[b]) + 1]++;
+	for (i = 0; i <= maxsize; i++)
+		bysize[i + 1] += bysize[i];
+	for (b = 0; b < nb; b++)
+		pos[bysize[maxsize - (start[b + 1] - start[b])]++] = b;
+	free(bysize);
+
+	for (j = 0; j < nb; j++) {
+		b = (uint32_t)pos[j];
+		size = start[b + 1] - start[b];
+		if (!size)
+			break;
+
+		if (size == 1) {
+			while (taken[free_slot])
+				free_slot++;
+			disp[b] = PHASH_DIRECT | (uint32_t)free_slot;
+			taken[free_slot] = 1;
+			continue;
+		}
+
+		for (i = 0; i < size; i++)
+			for (k = i + 1; k < size; k++)
+				if (keys[order[start[b] + i]] == keys[order[start[b] + k]])
+					return -EEXIST;
+
+		for (d = 0; d < PHASH_MAX_DISP; d++) {
+			for (i = 0; i < size; i++) {
+				uint64_t s = __phash_slot(hashes[order[start[b] + i]], d, m);
+
+				if (taken[s])
+					break;
+				taken[s] = 2;	/* tentatively, for this bucket */
+			}
+			if (i == size)
+				break;
+			while (i--)
+				taken[__phash_slot(hashes[order[start[b] + i]], d, m)] = 0;
+		}
+		if (d == PHASH_MAX_DISP)
+			return -EAGAIN;
+
+		disp[b] = d;
+		for (i = 0; i < size; i++)
+			taken[__phash_slot(hashes[order[start[b] + i]], d, m)] = 1;
+	}
+
+	for (i = 0; i < n; i++) {
+		uint64_t h = hashes[i];
+		uint64_t s = __phash_slot(h, disp[__phash_reduce(h, nb)], m);
+
+		slots[s].key = keys[i];
+		slots[s].val = vals[i];
+	}
+
+	return 0;
+}
+
+/**
+ * phash_build - build a frozen table from arrays of keys and values
+ * @ph: the table to build
+ * @keys: @n distinct keys
+ * @vals: the value of each key
+ * @n: number of keys, less than 2^31
+ *
+ * Returns 0 on success, -EEXIST if @keys has duplicates and -ENOMEM on
+ * allocation failure (or if no seed worked, which is very unlikely).
+ */
+static inline int phash_build(struct phash *ph, const uint64_t *keys,
+			      const uint64_t *vals, uint64_t n)
+{
+	uint32_t nb = (uint32_t)(n / PHASH_LAMBDA + 1);
+	uint64_t disp_off = sizeof(struct phash_header);
+	uint64_t slots_off = (disp_off + sizeof(uint32_t) * nb + 15) & ~15ULL;
+	uint64_t size = slots_off + sizeof(struct phash_entry) * n;
+	uint64_t *hashes, *pos;
+	uint32_t *order, *start;
+	uint8_t *taken;
+	unsigned int s;
+	void *base;
+	int ret = -ENOMEM;
+
+	if (n >= PHASH_DIRECT)
+		return -ENOMEM;
+
+	base = calloc(1, size);
+	hashes = (uint64_t *)malloc(sizeof(uint64_t) * (n + 1));
+	pos = (uint64_t *)malloc(sizeof(uint64_t) * (nb + 1));
+	order = (uint32_t *)malloc(sizeof(uint32_t) * (n + 1));
+	start = (uint32_t *)malloc(sizeof(uint32_t) * (nb + 1));
+	taken = (uint8_t *)malloc(n + 1);
+	if (!base || !hashes || !pos || !order || !start || !taken)
+		goto out;
+
+	ph->hdr = (struct phash_header *)base;
+	ph->hdr->magic = PHASH_MAGIC;
+	ph->hdr->version = PHASH_VERSION;
+	ph->hdr->nbuckets = nb;
+	ph->hdr->nkeys = n;
+	ph->hdr->disp_off = disp_off;
+	ph->hdr->slots_off = slots_off;
+	ph->hdr->size = size;
+	__phash_setup(ph, base);
+	ph->mapped = false;
+
+	for (s = 0; s < PHASH_MAX_SEEDS; s++) {
+		ph->hdr->seed = hash_64(s + 1, 64);
+		memset(pos, 0, sizeof(uint64_t) * (nb + 1));
+		ret = __phash_place(ph->hdr, (uint32_t *)ph->disp,
+				    (struct phash_entry *)ph->slots, keys, vals,
+				    hashes, order, start, taken, pos);
+		if (ret != -EAGAIN)
+			break;
+	}
+	if (ret == -EAGAIN)
+		ret = -ENOMEM;
+out:
+	if (ret) {
+		free(base);
+		ph->hdr = NULL;
+	}
+	free(hashes);
+	free(pos);
+	free(order);
+	free(start);
+	free(taken);
+	return ret;
+}
+
+#define __phash_val_ptr(obj, field)	((uint64_t)(uintptr_t)(obj))
+#define __phash_val_field(obj, field)	((uint64_t)(obj)->field)
+
+#define __phash_freeze(ph, name, type, member, keyfield, valfield, val_of)\
+({									\
+	uint64_t __n = 0, __i = 0, *__keys, *__vals;			\
+	unsigned int __bkt;						\
+	type *__obj;							\
+	int __ret = -ENOMEM;						\
+									\
+	hash_for_each(name, __bkt, __obj, member)			\
+		__n++;							\
+	__keys = (uint64_t *)malloc(sizeof(uint64_t) * (__n + 1));	\
+	__vals = (uint64_t *)malloc(sizeof(uint64_t) * (__n + 1));	\
+	if (__keys && __vals) {						\
+		hash_for_each(name, __bkt, __obj, member) {		\
+			__keys[__i] = (uint64_t)__obj->keyfield;	\
+			__vals[__i++] = val_of(__obj, valfield);	\
+		}							\
+		__ret = phash_build(ph, __keys, __vals, __n);		\
+	}								\
+	free(__keys);							\
+	free(__vals);							\
+	__ret;								\
+})
+
+/**
+ * phash_freeze - build a frozen table from a DEFINE_HASHTABLE() table
+ * @ph: the &struct phash to build
+ * @name: populated hashtable, left untouched
+ * @type: type of the objects in @name
+ * @member: the name of the hlist_node within the struct
+ * @keyfield: the name of the integer key field within the struct
+ *
+ * Entry values are the object pointers. Returns 0, -EEXIST or -ENOMEM as
+ * phash_build() does.
+ */
+#define phash_freeze(ph, name, type, member, keyfield)			\
+	__phash_freeze(ph, name, type, member, keyfield, keyfield,	\
+		       __phash_val_ptr)
+
+/**
+ * phash_freeze_field - build a frozen table whose values come from a field
+ * @ph: the &struct phash to build
+ * @name: populated hashtable, left untouched
+ * @type: type of the objects in @name
+ * @member: the name of the hlist_node within the struct
+ * @keyfield: the name of the integer key field within the struct
+ * @valfield: the name of the integer field stored as each entry's value
+ */
+#define phash_freeze_field(ph, name, type, member, keyfield, valfield)	\
+	__phash_freeze(ph, name, type, member, keyfield, valfield,	\
+		       __phash_val_field)
+
+/**
+ * phash_destroy - release a built or mapped frozen table
+ * @ph: the table to destroy
+ */
+static inline void phash_destroy(struct phash *ph)
+{
+	if (!ph->hdr)
+		return;
+	if (ph->mapped)
+		munmap(ph->hdr, ph->hdr->size);
+	else
+		free(ph->hdr);
+	ph->hdr = NULL;
+}
+
+/**
+ * phash_save - write a frozen table image to a file
+ * @ph: the table to save
+ * @path: file to create or truncate
+ *
+ * Returns 0 on success and -errno on failure.
+ */
+static inline int phash_save(const struct phash *ph, const char *path)
+{
+	FILE *f = fopen(path, "wb");
+	int ret = 0;
+
+	if (!f)
+		return -errno;
+	if (fwrite(ph->hdr, 1, ph->hdr->size, f) != ph->hdr->size)
+		ret = -EIO;
+	if (fclose(f) && !ret)
+		ret = -errno;
+
+	return ret;
+}
+
+/*
+ * Header of a mapped image of @size bytes: the arrays lie between the
+ * header and the end of the file, in order and aligned. Sizes are checked
+ * by division, so a crafted count can't wrap an offset back into range.
+ */
+static inline bool __phash_header_ok(const struct phash_header *hdr,
+				     uint64_t size)
+{
+	uint64_t disp_end;
+
+	if (hdr->magic != PHASH_MAGIC || hdr->version != PHASH_VERSION ||
+	    hdr->size != size)
+		return false;
+	if (hdr->nkeys && !hdr->nbuckets)
+		return false;
+	if (hdr->disp_off < sizeof(struct phash_header) ||
+	    hdr->disp_off > size || (hdr->disp_off & 3) ||
+	    hdr->nbuckets > (size - hdr->disp_off) / sizeof(uint32_t))
+		return false;
+	disp_end = hdr->disp_off + sizeof(uint32_t) * hdr->nbuckets;
+	if (hdr->slots_off < disp_end || hdr->slots_off > size ||
+	    (hdr->slots_off & 7) ||
+	    hdr->nkeys > (size - hdr->slots_off) / sizeof(struct phash_entry))
+		return false;
+	return true;
+}
+
+/*
+ * Images carry no checksum, so a direct slot is checked once on map: a
+ * crafted one would otherwise make phash_lookup() index past slots[].
+ */
+static inline bool __phash_disp_ok(const struct phash *ph)
+{
+	uint32_t b;
+
+	for (b = 0; b < ph->hdr->nbuckets; b++) {
+		if ((ph->disp[b] & PHASH_DIRECT) &&
+		    (ph->disp[b] & ~PHASH_DIRECT) >= ph->hdr->nkeys)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * phash_map - map a frozen table image written by phash_save()
+ * @ph: the table to set up
+ * @path: the image file
+ *
+ * The file is mapped read-only and used in place. Returns 0 on success,
+ * -EINVAL if the file isn't a valid image of this version and -errno if
+ * it can't be opened or mapped.
+ */
+static inline int phash_map(struct phash *ph, const char *path)
+{
+	struct phash_header *hdr;
+	struct stat st;
+	int fd, ret = 0;
+	void *base;
+
+	ph->hdr = NULL;
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st)) {
+		ret = -errno;
+		goto out;
+	}
+	if ((size_t)st.st_size < sizeof(struct phash_header)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		ret = -errno;
+		goto out;
+	}
+
+	hdr = (struct phash_header *)base;
+	if (!__phash_header_ok(hdr, st.st_size)) {
+		munmap(base, st.st_size);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	__phash_setup(ph, base);
+	if (!__phash_disp_ok(ph)) {
+		ph->hdr = NULL;
+		munmap(base, st.st_size);
+		ret = -EINVAL;
+		goto out;
+	}
+	ph->mapped = true;
+out:
+	close(fd);
+	return ret;
+}
+
+#endif /* __PHASH_H__ */
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "phash.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+#define TABLE_BITS 20
+#define IMAGE      "/tmp/phash_test.img"
+
+struct item
+{
+    uint64_t key;
+    uint64_t id;
+    struct hlist_node node;
+    char payload[40];
+};
+
+DEFINE_HASHTABLE(table, TABLE_BITS);
+DEFINE_HASHTABLE(dups, 4);
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+}
+
+static struct item *lookup(uint64_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible(table, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+/* overwrite the header of IMAGE */
+static int patch_header(const struct phash_header *hdr)
+{
+    int fd = open(IMAGE, O_WRONLY), ret = 0;
+
+    if (fd < 0)
+        return -errno;
+    if (pwrite(fd, hdr, sizeof(*hdr), 0) != (ssize_t)sizeof(*hdr))
+        ret = -EIO;
+    close(fd);
+    return ret;
+}
+
+/* overwrite displacement @b of IMAGE */
+static int patch_disp(const struct phash_header *hdr, uint32_t b, uint32_t d)
+{
+    int fd = open(IMAGE, O_WRONLY), ret = 0;
+
+    if (fd < 0)
+        return -errno;
+    if (pwrite(fd, &d, sizeof(d), hdr->disp_off + sizeof(d) * b) !=
+        (ssize_t)sizeof(d))
+        ret = -EIO;
+    close(fd);
+    return ret;
+}
+
+void TEST_PHASH(struct item *items, int n)
+{
+    const struct phash_entry *e;
+    struct item two[2];
+    struct phash ph, mapped = { NULL };
+    struct phash_header hdr, bad;
+    bool ok = true;
+    int i;
+
+    if (phash_freeze(&ph, table, struct item, node, key)) {
+        printf("%-28s" KRED "\tFAILED\n" RESET, "TEST_PHASH");
+        return;
+    }
+    if (phash_count(&ph) != (unsigned long)n)
+        ok = false;
+    for (i = 0; i < n; i++) {
+        e = phash_lookup(&ph, items[i].key);
+        if (!e || (struct item *)(uintptr_t)e->val != &items[i])
+            ok = false;
+    }
+    for (i = 0; i < 1000; i++) {
+        uint64_t k = rand64();
+
+        if ((phash_lookup(&ph, k) != NULL) != (lookup(k) != NULL))
+            ok = false;
+    }
+    phash_destroy(&ph);
+
+    /* an image of ids survives the trip through a file */
+    if (phash_freeze_field(&ph, table, struct item, node, key, id) ||
+        phash_save(&ph, IMAGE) || phash_map(&mapped, IMAGE)) {
+        ok = false;
+    } else {
+        for (i = 0; i < n; i++) {
+            e = phash_lookup(&mapped, items[i].key);
+            if (!e || e->val != items[i].id)
+                ok = false;
+        }
+        hdr = *mapped.hdr;
+        phash_destroy(&mapped);
+
+        /* counts that wrap the end offset, and arrays inside the header */
+        bad = hdr;
+        bad.nkeys = 1ULL << 60;
+        if (patch_header(&bad) || phash_map(&mapped, IMAGE) != -EINVAL)
+            ok = false;
+        bad = hdr;
+        bad.disp_off = 0;
+        if (patch_header(&bad) || phash_map(&mapped, IMAGE) != -EINVAL)
+            ok = false;
+        bad = hdr;
+        bad.nbuckets = 0;
+        if (patch_header(&bad) || phash_map(&mapped, IMAGE) != -EINVAL)
+            ok = false;
+
+        /* a direct slot past the end of slots[] in a sound header */
+        if (patch_header(&hdr) ||
+            patch_disp(&hdr, hdr.nbuckets - 1, PHASH_DIRECT | 0x7ffffff0) ||
+            phash_map(&mapped, IMAGE) != -EINVAL)
+            ok = false;
+    }
+    phash_destroy(&ph);
+    unlink(IMAGE);
+
+    hash_init(dups);
+    two[0].key = two[1].key = 42;
+    hash_add(dups, &two[0].node, two[0].key);
+    hash_add(dups, &two[1].node, two[1].key);
+    if (phash_freeze(&ph, dups, struct item, node, key) != -EEXIST)
+        ok = false;
+
+    printf("%-28s", "TEST_PHASH");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+void compare_lookup(struct item *items, int n)
+{
+    uint64_t *keys = (uint64_t *)malloc(sizeof(uint64_t) * n);
+    unsigned long found = 0;
+    struct phash ph;
+    double tb, tc, tp;
+    int i;
+
+    for (i = 0; i < n; i++)
+        keys[i] = items[rand() % n].key;
+
+    tb = now();
+    if (phash_freeze(&ph, table, struct item, node, key)) {
+        fprintf(stderr, "freeze failed\n");
+        exit(1);
+    }
+    tb = now() - tb;
+
+    tc = now();
+    for (i = 0; i < n; i++)
+        found += lookup(keys[i]) != NULL;
+    tc = now() - tc;
+
+    tp = now();
+    for (i = 0; i < n; i++)
+        found += phash_lookup(&ph, keys[i]) != NULL;
+    tp = now() - tp;
+
+    printf("%-10s%-12s%-16s%-16s%-14s\n", "Objects", "Freeze(ms)",
+           "Chained(ns/op)", "Frozen(ns/op)", "Frozen B/key");
+    printf("%-10d%-12.1f%-16.1f%-16.1f%-14.2f\n", n, tb * 1e3,
+           tc * 1e9 / n, tp * 1e9 / n, (double)ph.hdr->size / n);
+    if (found != 2UL * n)
+        printf(KRED "%lu of %d lookups found\n" RESET, found, 2 * n);
+
+    phash_destroy(&ph);
+    free(keys);
+}
+
+int main(int argc, char **argv)
+{
+    struct item *items;
+    int n, i;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <nobjects>\n", argv[0]);
+        exit(1);
+    }
+    n = atoi(argv[1]);
+
+    srand((unsigned)time(0));
+    items = (struct item *)malloc(sizeof(struct item) * n);
+    hash_init(table);
+    for (i = 0; i < n; i++) {
+        items[i].key = rand64();
+        items[i].id = i;
+        hash_add(table, &items[i].node, items[i].key);
+    }
+
+    TEST_PHASH(items, n);
+    compare_lookup(items, n);
+
+    free(items);
+    return 0;
+}
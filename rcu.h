@@ -0,0 +1,314 @@
+#ifndef __RCU_H__
+#define __RCU_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <assert.h>
+
+/*
+ * Userspace read-copy-update.
+ *
+ * Readers bracket their accesses with rcu_read_lock()/rcu_read_unlock(),
+ * which only touch a per-thread counter and never block or take a lock.
+ * Updaters publish new objects with rcu_assign_pointer() and must not free
+ * an object they unlinked until every reader that might still see it has
+ * left its read-side critical section: either wait for that with
+ * synchronize_rcu(), or hand the object to call_rcu() and let a background
+ * thread free it after a grace period.
+ *
+ * Grace periods are detected the way liburcu's "memb" flavour does it: a
+ * global counter carries a phase bit that each reader snapshots when it
+ * enters its outermost critical section. synchronize_rcu() flips the
+ * phase twice and waits for every reader still running in the old phase.
+ *
+ * Every thread that calls rcu_read_lock() must be registered with
+ * rcu_register_thread() first, and unregistered before it exits.
+ */
+
+#ifndef barrier
+#define barrier()	__asm__ __volatile__("" : : : "memory")
+#endif
+#define smp_mb()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#define READ_ONCE(x)		__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, val)	__atomic_store_n(&(x), (val), __ATOMIC_RELAXED)
+
+/**
+ * rcu_assign_pointer - publish a pointer to readers
+ * @p: the pointer to assign to
+ * @v: the value to publish
+ *
+ * Release semantics: every initializing store to *@v is visible before a
+ * reader can observe @v through @p.
+ */
+#define rcu_assign_pointer(p, v)	__atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/**
+ * rcu_dereference - fetch an RCU-protected pointer for dereferencing
+ * @p: the pointer to read
+ */
+#define rcu_dereference(p)		__atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+#define RCU_GP_COUNT		1UL
+#define RCU_GP_PHASE		(1UL << (sizeof(unsigned long) * 4))
+#define RCU_NEST_MASK		(RCU_GP_PHASE - 1)
+
+struct rcu_head
+{
+	struct rcu_head *next;
+	void (*func)(struct rcu_head *head);
+};
+
+struct rcu_reader
+{
+	unsigned long ctr;		/* nesting count | phase snapshot */
+	bool registered;
+	struct rcu_reader *next, **pprev;
+};
+
+struct rcu_state
+{
+	unsigned long gp_ctr;
+	pthread_mutex_t gp_lock;	/* serializes grace periods and registry */
+	struct rcu_reader *readers;
+
+	pthread_mutex_t cb_lock;
+	pthread_cond_t cb_wake;
+	pthread_cond_t cb_idle;
+	struct rcu_head *cb_head, **cb_tail;
+	unsigned long cb_pending;	/* queued but not yet invoked */
+	bool cb_worker;
+};
+
+/*
+ * Weak so that every translation unit including this header shares one
+ * RCU domain.
+ */
+struct rcu_state rcu_state __attribute__((weak)) = {
+	.gp_ctr = RCU_GP_COUNT,
+	.gp_lock = PTHREAD_MUTEX_INITIALIZER,
+	.readers = NULL,
+	.cb_lock = PTHREAD_MUTEX_INITIALIZER,
+	.cb_wake = PTHREAD_COND_INITIALIZER,
+	.cb_idle = PTHREAD_COND_INITIALIZER,
+	.cb_head = NULL,
+	.cb_tail = &rcu_state.cb_head,
+	.cb_pending = 0,
+	.cb_worker = false,
+};
+
+__thread struct rcu_reader rcu_reader __attribute__((weak));
+
+/**
+ * rcu_register_thread - make the calling thread visible to synchronize_rcu()
+ */
+static inline void rcu_register_thread(void)
+{
+	struct rcu_reader *r = &rcu_reader;
+
+	pthread_mutex_lock(&rcu_state.gp_lock);
+	r->ctr = 0;
+	r->next = rcu_state.readers;
+	if (r->next)
+		r->next->pprev = &r->next;
+	r->pprev = &rcu_state.readers;
+	rcu_state.readers = r;
+	r->registered = true;
+	pthread_mutex_unlock(&rcu_state.gp_lock);
+}
+
+/**
+ * rcu_unregister_thread - remove the calling thread from the reader registry
+ *
+ * Must not be called inside a read-side critical section.
+ */
+static inline void rcu_unregister_thread(void)
+{
+	struct rcu_reader *r = &rcu_reader;
+
+	assert(!(r->ctr & RCU_NEST_MASK));
+
+	pthread_mutex_lock(&rcu_state.gp_lock);
+	*r->pprev = r->next;
+	if (r->next)
+		r->next->pprev = r->pprev;
+	r->registered = false;
+	pthread_mutex_unlock(&rcu_state.gp_lock);
+}
+
+/**
+ * rcu_read_lock - mark the beginning of an RCU read-side critical section
+ *
+ * Critical sections nest. Only the outermost one snapshots the grace
+ * period counter, and it never blocks.
+ */
+static inline void rcu_read_lock(void)
+{
+	struct rcu_reader *r = &rcu_reader;
+	unsigned long tmp = r->ctr;
+
+	assert(r->registered);
+
+	if (!(tmp & RCU_NEST_MASK)) {
+		WRITE_ONCE(r->ctr, READ_ONCE(rcu_state.gp_ctr));
+		/* order the snapshot before any read of protected data */
+		smp_mb();
+	} else {
+		WRITE_ONCE(r->ctr, tmp + RCU_GP_COUNT);
+	}
+}
+
+/**
+ * rcu_read_unlock - mark the end of an RCU read-side critical section
+ */
+static inline void rcu_read_unlock(void)
+{
+	struct rcu_reader *r = &rcu_reader;
+
+	/* order reads of protected data before leaving the section */
+	smp_mb();
+	WRITE_ONCE(r->ctr, r->ctr - RCU_GP_COUNT);
+}
+
+/* reader is inside a critical section that began before the last flip */
+static inline bool __rcu_reader_ongoing(struct rcu_reader *r)
+{
+	unsigned long v = READ_ONCE(r->ctr);
+
+	return (v & RCU_NEST_MASK) &&
+	       ((v ^ READ_ONCE(rcu_state.gp_ctr)) & RCU_GP_PHASE);
+}
+
+static inline void __rcu_wait_for_readers(void)
+{
+	struct rcu_reader *r;
+	unsigned int spins;
+
+	for (r = rcu_state.readers; r; r = r->next) {
+		for (spins = 0; __rcu_reader_ongoing(r); spins++) {
+			if (spins > 100)
+				sched_yield();
+		}
+	}
+}
+
+/**
+ * synchronize_rcu - wait until all pre-existing readers have finished
+ *
+ * On return, no read-side critical section that started before the call
+ * can still hold a reference to an object unlinked before the call.
+ * Must not be called from inside a read-side critical section.
+ */
+static inline void synchronize_rcu(void)
+{
+	assert(!(rcu_reader.ctr & RCU_NEST_MASK));
+
+	pthread_mutex_lock(&rcu_state.gp_lock);
+
+	/* order prior unlinking stores before the phase flips */
+	smp_mb();
+
+	/*
+	 * A reader already inside its critical section may hold either phase
+	 * (it can load gp_ctr long before storing the snapshot). Flipping
+	 * twice guarantees one of the two waits sees its snapshot differ
+	 * from gp_ctr, whichever phase it holds.
+	 */
+	WRITE_ONCE(rcu_state.gp_ctr, rcu_state.gp_ctr ^ RCU_GP_PHASE);
+	smp_mb();
+	__rcu_wait_for_readers();
+
+	WRITE_ONCE(rcu_state.gp_ctr, rcu_state.gp_ctr ^ RCU_GP_PHASE);
+	smp_mb();
+	__rcu_wait_for_readers();
+
+	/* order the wait before the caller frees anything */
+	smp_mb();
+
+	pthread_mutex_unlock(&rcu_state.gp_lock);
+}
+
+static inline void *__rcu_callback_worker(void *arg)
+{
+	struct rcu_head *list, *next;
+	unsigned long n;
+
+	(void)arg;
+
+	pthread_mutex_lock(&rcu_state.cb_lock);
+	for (;;) {
+		while (!rcu_state.cb_head)
+			pthread_cond_wait(&rcu_state.cb_wake, &rcu_state.cb_lock);
+
+		list = rcu_state.cb_head;
+		rcu_state.cb_head = NULL;
+		rcu_state.cb_tail = &rcu_state.cb_head;
+		pthread_mutex_unlock(&rcu_state.cb_lock);
+
+		synchronize_rcu();
+		for (n = 0; list; list = next, n++) {
+			next = list->next;
+			list->func(list);
+		}
+
+		pthread_mutex_lock(&rcu_state.cb_lock);
+		rcu_state.cb_pending -= n;
+		if (!rcu_state.cb_pending)
+			pthread_cond_broadcast(&rcu_state.cb_idle);
+	}
+
+	return NULL;
+}
+
+/**
+ * call_rcu - queue a callback for invocation after a grace period
+ * @head: structure to be used for queueing the RCU updates
+ * @func: actual callback function to be invoked after the grace period
+ *
+ * Never blocks on readers; callbacks run on a background thread that is
+ * started on first use. Safe to call from a read-side critical section.
+ */
+static inline void call_rcu(struct rcu_head *head,
+			    void (*func)(struct rcu_head *head))
+{
+	pthread_t tid;
+
+	head->func = func;
+	head->next = NULL;
+
+	pthread_mutex_lock(&rcu_state.cb_lock);
+	if (!rcu_state.cb_worker &&
+	    !pthread_create(&tid, NULL, __rcu_callback_worker, NULL)) {
+		pthread_detach(tid);
+		rcu_state.cb_worker = true;
+	}
+
+	/*
+	 * Only an empty queue needs a wakeup: callbacks queued while the
+	 * worker waits for a grace period are picked up as one batch.
+	 */
+	if (!rcu_state.cb_head)
+		pthread_cond_signal(&rcu_state.cb_wake);
+	*rcu_state.cb_tail = head;
+	rcu_state.cb_tail = &head->next;
+	rcu_state.cb_pending++;
+	pthread_mutex_unlock(&rcu_state.cb_lock);
+}
+
+/**
+ * rcu_barrier - wait for all queued call_rcu() callbacks to be invoked
+ *
+ * Must not be called from inside a read-side critical section.
+ */
+static inline void rcu_barrier(void)
+{
+	pthread_mutex_lock(&rcu_state.cb_lock);
+	while (rcu_state.cb_pending) {
+		pthread_cond_signal(&rcu_state.cb_wake);
+		pthread_cond_wait(&rcu_state.cb_idle, &rcu_state.cb_lock);
+	}
+	pthread_mutex_unlock(&rcu_state.cb_lock);
+}
+
+#endif /* __RCU_H__ */
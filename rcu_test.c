@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "hashtable.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+#define TABLE_BITS 12
+#define NKEYS      (1 << 14)
+#define LIVE       0x5a5a5a5aU
+
+struct item
+{
+    uint32_t key;
+    uint32_t magic;
+    struct hlist_node node;
+    struct rcu_head rcu;
+};
+
+DEFINE_HASHTABLE(table, TABLE_BITS);
+
+static pthread_mutex_t update_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t table_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static volatile int stop;
+static unsigned long bad_reads;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static struct item *item_alloc(uint32_t key)
+{
+    struct item *it = (struct item *)malloc(sizeof(struct item));
+    it->key = key;
+    it->magic = LIVE;
+    INIT_HLIST_NODE(&it->node);
+    return it;
+}
+
+static void item_free_rcu(struct rcu_head *head)
+{
+    struct item *it = container_of(head, struct item, rcu);
+
+    /* a reader that still saw this object would now read a bad magic */
+    it->magic = 0;
+    free(it);
+}
+
+static struct item *lookup_rcu(uint32_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible_rcu(table, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+static struct item *lookup(uint32_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible(table, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+/* replace every key with a fresh copy, freeing the old one after a grace period */
+static void *updater(void *arg)
+{
+    unsigned long seq = 0;
+    struct item *old, *new;
+    uint32_t key;
+
+    (void)arg;
+
+    while (!stop) {
+        key = seq++ % NKEYS;
+        new = item_alloc(key);
+
+        pthread_mutex_lock(&update_lock);
+        pthread_rwlock_wrlock(&table_rwlock);
+        old = lookup(key);
+        hlist_replace_rcu(&old->node, &new->node);
+        pthread_rwlock_unlock(&table_rwlock);
+        pthread_mutex_unlock(&update_lock);
+
+        if (seq % 1024 == 0) {
+            synchronize_rcu();
+            item_free_rcu(&old->rcu);
+        } else {
+            call_rcu(&old->rcu, item_free_rcu);
+        }
+    }
+
+    return NULL;
+}
+
+struct reader_arg
+{
+    int use_rcu;
+    unsigned long ops;
+    unsigned long bad;
+};
+
+static void *reader(void *arg)
+{
+    struct reader_arg *ra = (struct reader_arg *)arg;
+    unsigned int seed = (unsigned int)(unsigned long)ra;
+    struct item *obj;
+    uint32_t key;
+
+    rcu_register_thread();
+    while (!stop) {
+        key = rand_r(&seed) % NKEYS;
+
+        if (ra->use_rcu) {
+            rcu_read_lock();
+            obj = lookup_rcu(key);
+            if (!obj || obj->magic != LIVE || obj->key != key)
+                ra->bad++;
+            rcu_read_unlock();
+        } else {
+            pthread_rwlock_rdlock(&table_rwlock);
+            obj = lookup(key);
+            if (!obj || obj->magic != LIVE || obj->key != key)
+                ra->bad++;
+            pthread_rwlock_unlock(&table_rwlock);
+        }
+        ra->ops++;
+    }
+    rcu_unregister_thread();
+
+    return NULL;
+}
+
+static double run(int nthreads, int use_rcu, double secs)
+{
+    pthread_t upd, *tids = (pthread_t *)malloc(sizeof(pthread_t) * nthreads);
+    struct reader_arg *args =
+        (struct reader_arg *)calloc(nthreads, sizeof(struct reader_arg));
+    unsigned long ops = 0;
+    double t;
+    int i;
+
+    stop = 0;
+    for (i = 0; i < nthreads; i++) {
+        args[i].use_rcu = use_rcu;
+        pthread_create(&tids[i], NULL, reader, &args[i]);
+    }
+    pthread_create(&upd, NULL, updater, NULL);
+
+    t = now();
+    while (now() - t < secs)
+        sched_yield();
+    stop = 1;
+
+    pthread_join(upd, NULL);
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(tids[i], NULL);
+        ops += args[i].ops;
+        bad_reads += args[i].bad;
+    }
+    t = now() - t;
+    rcu_barrier();
+
+    free(tids);
+    free(args);
+
+    return ops / t;
+}
+
+void TEST_SYNCHRONIZE_NESTED()
+{
+    bool ok = true;
+
+    rcu_register_thread();
+    rcu_read_lock();
+    rcu_read_lock();
+    rcu_read_unlock();
+    if (!(rcu_reader.ctr & RCU_NEST_MASK))
+        ok = false;
+    rcu_read_unlock();
+    if (rcu_reader.ctr & RCU_NEST_MASK)
+        ok = false;
+    synchronize_rcu();
+    rcu_unregister_thread();
+
+    printf("%-28s", "TEST_SYNCHRONIZE_NESTED");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+int main(int argc, char **argv)
+{
+    struct item *obj;
+    struct hlist_node *tmp;
+    unsigned int bkt;
+    int i, n, maxthreads;
+    double secs, r, l;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <max-readers> <seconds-per-run>\n", argv[0]);
+        exit(1);
+    }
+    maxthreads = atoi(argv[1]);
+    secs = atof(argv[2]);
+
+    TEST_SYNCHRONIZE_NESTED();
+
+    hash_init(table);
+    for (i = 0; i < NKEYS; i++) {
+        obj = item_alloc(i);
+        hash_add_rcu(table, &obj->node, obj->key);
+    }
+
+    printf("%-10s%-18s%-18s%-10s\n", "Readers", "RCU(Mops/s)",
+           "rwlock(Mops/s)", "Ratio");
+    for (n = 1; n <= maxthreads; n *= 2) {
+        r = run(n, 1, secs);
+        l = run(n, 0, secs);
+        printf("%-10d%-18.3f%-18.3f%-10.2f\n", n, r / 1e6, l / 1e6, r / l);
+    }
+
+    printf("%-28s", "TEST_RCU_READERS");
+    if (!bad_reads) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED (%lu bad reads)\n" RESET, bad_reads);
+
+    hash_for_each_safe(table, bkt, tmp, obj, node) {
+        hash_del(&obj->node);
+        free(obj);
+    }
+
+    return 0;
+}
@@ -0,0 +1,319 @@
+#ifndef __RHASHTABLE_H__
+#define __RHASHTABLE_H__
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "hash.h"
+#include "hashtable.h"
+
+/*
+ * Resizable hash table built on hlist_head buckets.
+ *
+ * Unlike DEFINE_HASHTABLE(), the bucket array lives on the heap and is
+ * doubled or halved when the number of entries crosses the load factor
+ * thresholds below. Resizing is incremental: a second bucket array is
+ * allocated and every add/del/lookup migrates a few buckets from the old
+ * array to the new one, so no single operation pays for an O(n) rehash.
+ *
+ * The table has no idea what the objects look like, so it asks @hashfn
+ * for a 64-bit hash key of each node whenever a bucket is migrated. For
+ * integer keys this can simply be the key itself; the bucket index is
+ * always taken from hash_64() of that value.
+ */
+
+#define RHASH_MIN_BITS		4
+#define RHASH_MAX_BITS		30
+#define RHASH_GROW_LOAD		1	/* grow when nelems > size * 1 */
+#define RHASH_SHRINK_LOAD	8	/* shrink when nelems < size / 8 */
+#define RHASH_REHASH_STEP	4	/* non-empty buckets moved per update */
+
+typedef uint64_t (*rhash_hashfn_t)(const struct hlist_node *node);
+
+struct rhashtable
+{
+	struct hlist_head *tbl;		/* live table, the old one while rehashing */
+	struct hlist_head *new_tbl;	/* resize target, NULL when not rehashing */
+	unsigned int bits;
+	unsigned int new_bits;
+	unsigned long rehash_idx;	/* next bucket of @tbl to migrate */
+	unsigned long nelems;
+	unsigned int min_bits;
+	rhash_hashfn_t hashfn;
+};
+
+static inline struct hlist_head *__rhash_alloc(unsigned int bits)
+{
+	/* an all-zero hlist_head is an empty bucket */
+	return (struct hlist_head *)calloc(1UL << bits, sizeof(struct hlist_head));
+}
+
+/**
+ * rhash_init - initialize a resizable hashtable
+ * @ht: the table to initialize
+ * @bits: log2 of the initial (and minimum) number of buckets
+ * @hashfn: returns the 64-bit hash key of an object in the table
+ *
+ * Returns 0 on success and -ENOMEM if the bucket array can't be allocated.
+ */
+static inline int rhash_init(struct rhashtable *ht, unsigned int bits,
+			     rhash_hashfn_t hashfn)
+{
+	if (bits < RHASH_MIN_BITS)
+		bits = RHASH_MIN_BITS;
+	if (bits > RHASH_MAX_BITS)
+		bits = RHASH_MAX_BITS;
+
+	ht->tbl = __rhash_alloc(bits);
+	if (!ht->tbl)
+		return -ENOMEM;
+
+	ht->new_tbl = NULL;
+	ht->bits = bits;
+	ht->new_bits = 0;
+	ht->rehash_idx = 0;
+	ht->nelems = 0;
+	ht->min_bits = bits;
+	ht->hashfn = hashfn;
+
+	return 0;
+}
+
+/**
+ * rhash_destroy - release the bucket arrays of a table
+ * @ht: the table to destroy
+ *
+ * Objects still linked into the table are not touched.
+ */
+static inline void rhash_destroy(struct rhashtable *ht)
+{
+	free(ht->tbl);
+	free(ht->new_tbl);
+	ht->tbl = ht->new_tbl = NULL;
+	ht->nelems = 0;
+}
+
+static inline bool rhash_rehashing(const struct rhashtable *ht)
+{
+	return ht->new_tbl != NULL;
+}
+
+static inline unsigned long rhash_count(const struct rhashtable *ht)
+{
+	return ht->nelems;
+}
+
+static inline bool rhash_empty(const struct rhashtable *ht)
+{
+	return ht->nelems == 0;
+}
+
+/*
+ * Old buckets below rehash_idx have already been moved as a whole, so a
+ * key lives in exactly one of the two arrays and a lookup walks one chain.
+ */
+static inline struct hlist_head *rhash_bucket(const struct rhashtable *ht,
+					      uint64_t hash)
+{
+	unsigned long idx = hash_64(hash, ht->bits);
+
+	if (ht->new_tbl && idx < ht->rehash_idx)
+		return &ht->new_tbl[hash_64(hash, ht->new_bits)];
+
+	return &ht->tbl[idx];
+}
+
+static inline void __rhash_migrate_bucket(struct rhashtable *ht)
+{
+	struct hlist_head *old = &ht->tbl[ht->rehash_idx];
+	struct hlist_node *pos, *n;
+
+	hlist_for_each_safe(pos, n, old) {
+		__hlist_del(pos);
+		hlist_add_head(pos,
+			&ht->new_tbl[hash_64(ht->hashfn(pos), ht->new_bits)]);
+	}
+	ht->rehash_idx++;
+}
+
+static inline void __rhash_finish_rehash(struct rhashtable *ht)
+{
+	free(ht->tbl);
+	ht->tbl = ht->new_tbl;
+	ht->bits = ht->new_bits;
+	ht->new_tbl = NULL;
+	ht->new_bits = 0;
+	ht->rehash_idx = 0;
+}
+
+/**
+ * rhash_rehash_step - migrate up to @n non-empty buckets to the new table
+ * @ht: the table being resized
+ * @n: number of non-empty buckets to move
+ *
+ * Visits at most 10 * @n empty buckets so that a sparse old table can't
+ * make one step expensive either. Does nothing when no resize is running.
+ */
+static inline void rhash_rehash_step(struct rhashtable *ht, unsigned int n)
+{
+	unsigned long size = 1UL << ht->bits;
+	unsigned int empty_visits = n * 10;
+
+	if (!rhash_rehashing(ht))
+		return;
+
+	while (n && ht->rehash_idx < size) {
+		if (hlist_empty(&ht->tbl[ht->rehash_idx])) {
+			ht->rehash_idx++;
+			if (--empty_visits == 0)
+				break;
+			continue;
+		}
+		__rhash_migrate_bucket(ht);
+		n--;
+	}
+
+	if (ht->rehash_idx == size)
+		__rhash_finish_rehash(ht);
+}
+
+static inline void __rhash_start_resize(struct rhashtable *ht,
+					unsigned int new_bits)
+{
+	/* on allocation failure keep running on the current table */
+	ht->new_tbl = __rhash_alloc(new_bits);
+	if (!ht->new_tbl)
+		return;
+
+	ht->new_bits = new_bits;
+	ht->rehash_idx = 0;
+}
+
+static inline void __rhash_check_resize(struct rhashtable *ht)
+{
+	unsigned long size = 1UL << ht->bits;
+
+	if (rhash_rehashing(ht))
+		return;
+
+	if (ht->nelems > size * RHASH_GROW_LOAD && ht->bits < RHASH_MAX_BITS)
+		__rhash_start_resize(ht, ht->bits + 1);
+	else if (ht->nelems < size / RHASH_SHRINK_LOAD &&
+		 ht->bits > ht->min_bits)
+		__rhash_start_resize(ht, ht->bits - 1);
+}
+
+/**
+ * rhash_add - add an object to a resizable hashtable
+ * @ht: hashtable to add to
+ * @node: the &struct hlist_node of the object to be added
+ */
+static inline void rhash_add(struct rhashtable *ht, struct hlist_node *node)
+{
+	rhash_rehash_step(ht, RHASH_REHASH_STEP);
+	hlist_add_head(node, rhash_bucket(ht, ht->hashfn(node)));
+	ht->nelems++;
+	__rhash_check_resize(ht);
+}
+
+/**
+ * __rhash_del - remove an object without migrating or resizing
+ * @ht: hashtable to remove from
+ * @node: &struct hlist_node of the object to remove
+ *
+ * Safe to use inside rhash_for_each_safe(), which would otherwise see
+ * entries move under the cursor.
+ */
+static inline void __rhash_del(struct rhashtable *ht, struct hlist_node *node)
+{
+	if (hlist_unhashed(node))
+		return;
+
+	hlist_del_init(node);
+	ht->nelems--;
+}
+
+/**
+ * rhash_del - remove an object from a resizable hashtable
+ * @ht: hashtable to remove from
+ * @node: &struct hlist_node of the object to remove
+ */
+static inline void rhash_del(struct rhashtable *ht, struct hlist_node *node)
+{
+	__rhash_del(ht, node);
+	rhash_rehash_step(ht, RHASH_REHASH_STEP);
+	__rhash_check_resize(ht);
+}
+
+static inline struct hlist_head *__rhash_lookup_head(struct rhashtable *ht,
+						     uint64_t hash)
+{
+	rhash_rehash_step(ht, 1);
+	return rhash_bucket(ht, hash);
+}
+
+/*
+ * Buckets are numbered across both arrays while rehashing: [0, size) is
+ * the old table (already migrated buckets are empty) and the new table
+ * follows it.
+ */
+static inline unsigned long rhash_nr_buckets(const struct rhashtable *ht)
+{
+	return (1UL << ht->bits) + (ht->new_tbl ? 1UL << ht->new_bits : 0);
+}
+
+static inline struct hlist_head *rhash_bucket_at(const struct rhashtable *ht,
+						 unsigned long bkt)
+{
+	unsigned long size = 1UL << ht->bits;
+
+	return bkt < size ? &ht->tbl[bkt] : &ht->new_tbl[bkt - size];
+}
+
+/**
+ * rhash_for_each_possible - iterate over all possible objects hashing to the
+ * same bucket
+ * @ht: the &struct rhashtable to iterate
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ * @hash: the 64-bit hash key of the objects to iterate over
+ *
+ * Also advances a running resize by one bucket.
+ */
+#define rhash_for_each_possible(ht, obj, member, hash)			\
+	for (obj = hlist_entry_safe(__rhash_lookup_head(ht, hash)->first,	\
+				    typeof(*(obj)), member);		\
+	     obj;							\
+	     obj = hlist_entry_safe((obj)->member.next, typeof(*(obj)), member))
+
+/**
+ * rhash_for_each - iterate over a resizable hashtable
+ * @ht: the &struct rhashtable to iterate
+ * @bkt: unsigned long to use as bucket loop cursor
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ *
+ * The table must not be modified during the walk.
+ */
+#define rhash_for_each(ht, bkt, obj, member)				\
+	for ((bkt) = 0, obj = NULL;					\
+	     obj == NULL && (bkt) < rhash_nr_buckets(ht); (bkt)++)	\
+		hlist_for_each_entry(obj, rhash_bucket_at(ht, bkt), member)
+
+/**
+ * rhash_for_each_safe - iterate over a resizable hashtable safe against
+ * removal of hash entry
+ * @ht: the &struct rhashtable to iterate
+ * @bkt: unsigned long to use as bucket loop cursor
+ * @tmp: a &struct hlist_node used for temporary storage
+ * @obj: the type * to use as a loop cursor for each entry
+ * @member: the name of the hlist_node within the struct
+ *
+ * Remove entries with __rhash_del() only.
+ */
+#define rhash_for_each_safe(ht, bkt, tmp, obj, member)			\
+	for ((bkt) = 0, obj = NULL;					\
+	     obj == NULL && (bkt) < rhash_nr_buckets(ht); (bkt)++)	\
+		hlist_for_each_entry_safe(obj, tmp, rhash_bucket_at(ht, bkt), member)
+
+#endif /* __RHASHTABLE_H__ */
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rhashtable.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+struct item
+{
+    uint64_t key;
+    struct hlist_node node;
+};
+
+static uint64_t item_hash(const struct hlist_node *node)
+{
+    return hlist_entry(node, struct item, node)->key;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static struct item *rhash_find(struct rhashtable *ht, uint64_t key)
+{
+    struct item *obj;
+
+    rhash_for_each_possible(ht, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+void TEST_RHASH(int n)
+{
+    struct rhashtable ht;
+    struct item *items = (struct item *)malloc(sizeof(struct item) * n);
+    struct item *obj;
+    struct hlist_node *tmp;
+    unsigned long bkt, cnt = 0;
+    unsigned int max_bits = 0;
+    bool ok = true;
+    int i;
+
+    if (rhash_init(&ht, 4, item_hash)) {
+        fprintf(stderr, "rhash_init failed\n");
+        exit(1);
+    }
+
+    for (i = 0; i < n; i++) {
+        items[i].key = i * 7919ULL;
+        rhash_add(&ht, &items[i].node);
+        if (ht.bits > max_bits)
+            max_bits = ht.bits;
+    }
+
+    for (i = 0; i < n; i++)
+        if (rhash_find(&ht, i * 7919ULL) != &items[i])
+            ok = false;
+
+    rhash_for_each(&ht, bkt, obj, node)
+        cnt++;
+    if (cnt != (unsigned long)n || rhash_count(&ht) != (unsigned long)n)
+        ok = false;
+
+    /* drop all but every 16th entry, the table should shrink back */
+    for (i = 0; i < n; i++)
+        if (i % 16)
+            rhash_del(&ht, &items[i].node);
+
+    for (i = 0; i < n; i++) {
+        obj = rhash_find(&ht, i * 7919ULL);
+        if ((i % 16) ? obj != NULL : obj != &items[i])
+            ok = false;
+    }
+
+    rhash_for_each_safe(&ht, bkt, tmp, obj, node)
+        __rhash_del(&ht, &obj->node);
+    if (!rhash_empty(&ht))
+        ok = false;
+
+    printf("%-28s bits %u -> %u ", "TEST_RHASH", max_bits, ht.bits);
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+
+    rhash_destroy(&ht);
+    free(items);
+}
+
+/*
+ * compare against a fixed DEFINE_HASHTABLE() table: worst single insert
+ * latency (what incremental rehash is for) and lookup throughput once the
+ * fixed table's chains have grown long
+ */
+DEFINE_HASHTABLE(fixed, 10);
+
+void compare_fixed(int n)
+{
+    struct rhashtable ht;
+    struct item *a = (struct item *)malloc(sizeof(struct item) * n);
+    struct item *b = (struct item *)malloc(sizeof(struct item) * n);
+    struct item *obj;
+    double t, dt, max_r = 0, max_f = 0, t_r, t_f;
+    unsigned long found = 0;
+    int i;
+
+    srand((unsigned)time(0));
+    if (rhash_init(&ht, 4, item_hash)) {
+        fprintf(stderr, "rhash_init failed\n");
+        exit(1);
+    }
+    hash_init(fixed);
+
+    for (i = 0; i < n; i++) {
+        a[i].key = b[i].key = ((uint64_t)rand() << 31) ^ rand();
+
+        t = now();
+        rhash_add(&ht, &a[i].node);
+        dt = now() - t;
+        if (dt > max_r) max_r = dt;
+
+        t = now();
+        hash_add(fixed, &b[i].node, b[i].key);
+        dt = now() - t;
+        if (dt > max_f) max_f = dt;
+    }
+
+    t = now();
+    for (i = 0; i < n; i++)
+        if (rhash_find(&ht, a[i].key))
+            found++;
+    t_r = now() - t;
+
+    t = now();
+    for (i = 0; i < n; i++) {
+        hash_for_each_possible(fixed, obj, node, b[i].key) {
+            if (obj->key == b[i].key) {
+                found++;
+                break;
+            }
+        }
+    }
+    t_f = now() - t;
+
+    printf("%-10s%-10s%-18s%-18s%-15s\n", "Size", "Table", "Max insert(us)",
+           "Lookup(Mops/s)", "Buckets");
+    printf("%-10d%-10s%-18.3f%-18.3f%-15lu\n", n, "rhash", max_r * 1e6,
+           n / t_r / 1e6, rhash_nr_buckets(&ht));
+    printf("%-10d%-10s%-18.3f%-18.3f%-15lu\n", n, "fixed", max_f * 1e6,
+           n / t_f / 1e6, (unsigned long)HASH_SIZE(fixed));
+    if (found != 2UL * n)
+        printf(KRED "lookup mismatch: %lu\n" RESET, found);
+
+    rhash_destroy(&ht);
+    free(a);
+    free(b);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <num>\n", argv[0]);
+        exit(1);
+    }
+
+    TEST_RHASH(atoi(argv[1]));
+    compare_fixed(atoi(argv[1]));
+
+    return 0;
+}
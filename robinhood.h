@@ -0,0 +1,299 @@
+#ifndef __ROBINHOOD_H__
+#define __ROBINHOOD_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hash.h"
+
+/*
+ * Robin Hood open addressing hash table.
+ *
+ * Linear probing where an insert takes the slot of any entry that sits
+ * closer to its home slot than the new entry would, and carries the
+ * evicted entry on. Probe lengths stay short and even at high load, and a
+ * lookup can stop as soon as it meets an entry closer to home than itself.
+ * Deletion shifts the following displaced entries back by one slot, so
+ * there are no tombstones to slow down mixed insert/delete workloads.
+ *
+ * The probe length of every slot (plus one, zero meaning empty) is kept
+ * in a byte array next to the slots. It is bounded by RHOOD_MAX_PROBE: an
+ * insert that would go further grows the table instead, which caps the
+ * cost of any lookup.
+ *
+ * Keys are 64-bit integers hashed with hash_64(); the table doesn't own
+ * the objects it points to.
+ */
+
+#define RHOOD_MIN_BITS		3
+#define RHOOD_MAX_BITS		48
+#define RHOOD_MAX_PROBE		128
+#define RHOOD_MAX_LOAD_NUM	15	/* grow past 15/16 full */
+#define RHOOD_MAX_LOAD_DEN	16
+
+struct rhood_slot
+{
+	uint64_t key;
+	void *obj;
+};
+
+struct rhood_table
+{
+	uint8_t *dist;			/* probe length + 1, 0 for empty */
+	struct rhood_slot *slots;
+	unsigned int bits;
+	unsigned long size;
+};
+
+static inline unsigned long rhood_capacity(const struct rhood_table *t)
+{
+	return 1UL << t->bits;
+}
+
+static inline unsigned long rhood_count(const struct rhood_table *t)
+{
+	return t->size;
+}
+
+static inline bool rhood_empty(const struct rhood_table *t)
+{
+	return t->size == 0;
+}
+
+static inline unsigned long __rhood_home(uint64_t key, unsigned int bits)
+{
+	return hash_64(key, bits);
+}
+
+static inline int __rhood_alloc(struct rhood_table *t, unsigned int bits)
+{
+	unsigned long cap = 1UL << bits;
+
+	t->dist = (uint8_t *)calloc(cap, 1);
+	t->slots = (struct rhood_slot *)malloc(cap * sizeof(struct rhood_slot));
+	if (!t->dist || !t->slots) {
+		free(t->dist);
+		free(t->slots);
+		return -ENOMEM;
+	}
+
+	t->bits = bits;
+	t->size = 0;
+
+	return 0;
+}
+
+/**
+ * rhood_init - initialize a Robin Hood hashtable
+ * @t: the table to initialize
+ * @bits: log2 of the initial number of slots
+ *
+ * Returns 0 on success and -ENOMEM on allocation failure.
+ */
+static inline int rhood_init(struct rhood_table *t, unsigned int bits)
+{
+	if (bits < RHOOD_MIN_BITS)
+		bits = RHOOD_MIN_BITS;
+	if (bits > RHOOD_MAX_BITS)
+		bits = RHOOD_MAX_BITS;
+
+	return __rhood_alloc(t, bits);
+}
+
+/**
+ * rhood_destroy - release the arrays of a Robin Hood hashtable
+ * @t: the table to destroy
+ */
+static inline void rhood_destroy(struct rhood_table *t)
+{
+	free(t->dist);
+	free(t->slots);
+	t->dist = NULL;
+	t->slots = NULL;
+	t->size = 0;
+}
+
+/* find the slot holding @key, or -1 */
+static inline long __rhood_find(const struct rhood_table *t, uint64_t key)
+{
+	unsigned long mask = rhood_capacity(t) - 1;
+	unsigned long pos = __rhood_home(key, t->bits);
+	unsigned int d;
+
+	/* an entry closer to its home than we are to ours ends the search */
+	for (d = 1; t->dist[pos] >= d; d++, pos = (pos + 1) & mask)
+		if (t->dist[pos] == d && t->slots[pos].key == key)
+			return pos;
+
+	return -1;
+}
+
+/*
+ * Insert an entry, or return -EEXIST if its key is already present: that
+ * is only possible before the first swap, since a present key sits no
+ * further than the first entry that is closer to home than the probe. If
+ * the insert would take more than RHOOD_MAX_PROBE steps, returns -ENOSPC
+ * with *@key and *@obj set to the entry that is left over, which may be a
+ * displaced one.
+ */
+static inline int __rhood_insert(struct rhood_table *t, uint64_t *key,
+				 void **obj)
+{
+	unsigned long mask = rhood_capacity(t) - 1;
+	unsigned long pos = __rhood_home(*key, t->bits);
+	struct rhood_slot cur = { *key, *obj }, tmp;
+	unsigned int d = 1;
+	bool swapped = false;
+	uint8_t td;
+
+	for (;;) {
+		if (!t->dist[pos]) {
+			t->dist[pos] = d;
+			t->slots[pos] = cur;
+			t->size++;
+			return 0;
+		}
+
+		if (!swapped && t->dist[pos] == d && t->slots[pos].key == cur.key)
+			return -EEXIST;
+
+		/* take from the rich: the resident is closer to home than we are */
+		if (t->dist[pos] < d) {
+			swapped = true;
+			td = t->dist[pos];
+			tmp = t->slots[pos];
+			t->dist[pos] = d;
+			t->slots[pos] = cur;
+			d = td;
+			cur = tmp;
+		}
+
+		pos = (pos + 1) & mask;
+		if (++d > RHOOD_MAX_PROBE) {
+			*key = cur.key;
+			*obj = cur.obj;
+			return -ENOSPC;
+		}
+	}
+}
+
+/* rebuild into a table of 2^@bits slots, growing further if needed */
+static inline int __rhood_rehash(struct rhood_table *t, unsigned int bits)
+{
+	struct rhood_table old = *t;
+	unsigned long i;
+	uint64_t key;
+	void *obj;
+
+retry:
+	if (bits > RHOOD_MAX_BITS || __rhood_alloc(t, bits)) {
+		*t = old;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < rhood_capacity(&old); i++) {
+		if (!old.dist[i])
+			continue;
+		key = old.slots[i].key;
+		obj = old.slots[i].obj;
+		if (__rhood_insert(t, &key, &obj)) {
+			rhood_destroy(t);
+			bits++;
+			goto retry;
+		}
+	}
+
+	rhood_destroy(&old);
+	return 0;
+}
+
+/**
+ * rhood_lookup - find the object stored under @key
+ * @t: the table to search
+ * @key: the key to look up
+ *
+ * Returns the object, or NULL if @key isn't in the table.
+ */
+static inline void *rhood_lookup(const struct rhood_table *t, uint64_t key)
+{
+	long i = __rhood_find(t, key);
+
+	return i < 0 ? NULL : t->slots[i].obj;
+}
+
+/**
+ * rhood_add - add an object to a Robin Hood hashtable
+ * @t: the table to add to
+ * @key: the key of the object
+ * @obj: the object
+ *
+ * Returns 0 on success, -EEXIST if @key is already present and -ENOMEM
+ * if the table had to grow and couldn't.
+ */
+static inline int rhood_add(struct rhood_table *t, uint64_t key, void *obj)
+{
+	int ret;
+
+	if ((t->size + 1) * RHOOD_MAX_LOAD_DEN >
+	    rhood_capacity(t) * RHOOD_MAX_LOAD_NUM) {
+		if (__rhood_find(t, key) >= 0)
+			return -EEXIST;
+		if (__rhood_rehash(t, t->bits + 1))
+			return -ENOMEM;
+	}
+
+	/* the probe bound was hit: grow and place whatever was left over */
+	while ((ret = __rhood_insert(t, &key, &obj)) == -ENOSPC)
+		if (__rhood_rehash(t, t->bits + 1))
+			return -ENOMEM;
+
+	return ret;
+}
+
+/**
+ * rhood_del - remove the object stored under @key
+ * @t: the table to remove from
+ * @key: the key to remove
+ *
+ * Returns the removed object, or NULL if @key wasn't in the table.
+ */
+static inline void *rhood_del(struct rhood_table *t, uint64_t key)
+{
+	unsigned long mask = rhood_capacity(t) - 1;
+	long i = __rhood_find(t, key);
+	unsigned long pos, next;
+	void *obj;
+
+	if (i < 0)
+		return NULL;
+
+	obj = t->slots[i].obj;
+
+	/* backward shift: pull displaced successors one slot closer to home */
+	for (pos = i, next = (pos + 1) & mask; t->dist[next] > 1;
+	     pos = next, next = (next + 1) & mask) {
+		t->dist[pos] = t->dist[next] - 1;
+		t->slots[pos] = t->slots[next];
+	}
+	t->dist[pos] = 0;
+	t->size--;
+
+	return obj;
+}
+
+/**
+ * rhood_for_each - iterate over a Robin Hood hashtable
+ * @t: the &struct rhood_table to iterate
+ * @i: unsigned long to use as slot loop cursor
+ * @slot: the struct rhood_slot * to use as a loop cursor for each entry
+ *
+ * The table must not be modified during the walk.
+ */
+#define rhood_for_each(t, i, slot)					\
+	for ((i) = 0; (i) < rhood_capacity(t); (i)++)			\
+		if (!((t)->dist[i] && ((slot) = &(t)->slots[i], 1))) {} else
+
+#endif /* __ROBINHOOD_H__ */
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hashtable.h"
+#include "robinhood.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+#define TABLE_BITS 20
+
+struct item
+{
+    uint64_t key;
+    struct hlist_node node;
+};
+
+DEFINE_HASHTABLE(table, TABLE_BITS);
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+}
+
+static struct item *lookup_chained(uint64_t key)
+{
+    struct item *obj;
+
+    hash_for_each_possible(table, obj, node, key) {
+        if (obj->key == key)
+            return obj;
+    }
+
+    return NULL;
+}
+
+/* every entry must sit exactly dist - 1 slots after its home */
+static bool check_dist(const struct rhood_table *t)
+{
+    unsigned long i, home;
+
+    for (i = 0; i < rhood_capacity(t); i++) {
+        if (!t->dist[i])
+            continue;
+        home = __rhood_home(t->slots[i].key, t->bits);
+        if (((i - home) & (rhood_capacity(t) - 1)) != t->dist[i] - 1u)
+            return false;
+    }
+
+    return true;
+}
+
+void TEST_RHOOD()
+{
+    static struct item items[20000];
+    struct rhood_slot *slot;
+    struct rhood_table t;
+    unsigned long i, cnt = 0;
+    bool ok = true;
+
+    if (rhood_init(&t, 0)) {
+        printf("%-28s" KRED "\tFAILED\n" RESET, "TEST_RHOOD");
+        return;
+    }
+    for (i = 0; i < 20000; i++) {
+        items[i].key = i << 20;
+        if (rhood_add(&t, items[i].key, &items[i]))
+            ok = false;
+    }
+    if (rhood_add(&t, items[3].key, &items[3]) != -EEXIST)
+        ok = false;
+    if (rhood_count(&t) != 20000 || !check_dist(&t))
+        ok = false;
+
+    for (i = 0; i < 20000; i += 2)
+        if (rhood_del(&t, items[i].key) != &items[i])
+            ok = false;
+    if (!check_dist(&t))
+        ok = false;
+    for (i = 0; i < 20000; i++)
+        if (rhood_lookup(&t, items[i].key) != ((i & 1) ? &items[i] : NULL))
+            ok = false;
+
+    rhood_for_each(&t, i, slot) {
+        if (((struct item *)slot->obj)->key != slot->key)
+            ok = false;
+        cnt++;
+    }
+    if (cnt != 10000 || rhood_count(&t) != 10000)
+        ok = false;
+
+    /* an else after the loop belongs to the caller's if */
+    if (cnt == 10000)
+        rhood_for_each(&t, i, slot)
+            cnt--;
+    else
+        ok = false;
+    if (cnt)
+        ok = false;
+    rhood_destroy(&t);
+
+    printf("%-28s", "TEST_RHOOD");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/*
+ * Fill both tables to @load of 2^TABLE_BITS, then replace a random entry
+ * and look up two others per step, so the load stays put.
+ */
+void compare_mixed(double load, unsigned long nops)
+{
+    unsigned long n = (unsigned long)(load * (1UL << TABLE_BITS));
+    struct item *items = (struct item *)malloc(sizeof(struct item) * n);
+    uint64_t *keys = (uint64_t *)malloc(sizeof(uint64_t) * n);
+    struct rhood_table t;
+    unsigned long i, j, misses = 0;
+    double t0, tc, tr;
+
+    if (rhood_init(&t, TABLE_BITS)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    hash_init(table);
+    for (i = 0; i < n; i++) {
+        items[i].key = keys[i] = rand64();
+        hash_add(table, &items[i].node, items[i].key);
+        rhood_add(&t, items[i].key, &items[i]);
+    }
+
+    srand(1);
+    t0 = now();
+    for (i = 0; i < nops; i++) {
+        j = (unsigned long)rand() % n;
+        hash_del(&items[j].node);
+        items[j].key = rand64();
+        hash_add(table, &items[j].node, items[j].key);
+        if (!lookup_chained(items[rand() % n].key) ||
+            !lookup_chained(items[rand() % n].key))
+            misses++;
+    }
+    tc = now() - t0;
+
+    /* replay the same sequence of replacements */
+    for (i = 0; i < n; i++)
+        items[i].key = keys[i];
+    srand(1);
+    t0 = now();
+    for (i = 0; i < nops; i++) {
+        j = (unsigned long)rand() % n;
+        rhood_del(&t, items[j].key);
+        items[j].key = rand64();
+        rhood_add(&t, items[j].key, &items[j]);
+        if (!rhood_lookup(&t, items[rand() % n].key) ||
+            !rhood_lookup(&t, items[rand() % n].key))
+            misses++;
+    }
+    tr = now() - t0;
+
+    printf("%-14s%-14s%-16s\n", "Table", "ns/step", "index B/entry");
+    printf("%-14s%-14.1f%-16.1f\n", "chained", tc * 1e9 / nops,
+           (double)(sizeof(struct hlist_head) * HASH_SIZE(table) +
+                    sizeof(struct hlist_node) * n) / n);
+    printf("%-14s%-14.1f%-16.1f\n", "robinhood", tr * 1e9 / nops,
+           (double)((sizeof(struct rhood_slot) + 1) * rhood_capacity(&t)) / n);
+    printf("(%lu entries, load %.2f, %u bits after the run)\n", n,
+           (double)rhood_count(&t) / rhood_capacity(&t), t.bits);
+
+    if (misses)
+        printf(KRED "%lu lookups failed\n" RESET, misses);
+
+    rhood_destroy(&t);
+    free(keys);
+    free(items);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <load-factor> <nops>\n", argv[0]);
+        exit(1);
+    }
+
+    TEST_RHOOD();
+    compare_mixed(atof(argv[1]), atol(argv[2]));
+
+    return 0;
+}
@@ -0,0 +1,345 @@
+#ifndef __SHARDCACHE_H__
+#define __SHARDCACHE_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "hash.h"
+#include "hashtable.h"
+#include "spinlock.h"
+#include "sys-queue.h"
+
+/*
+ * Sharded concurrent cache with SIEVE eviction.
+ *
+ * Keys are spread over 2^shard_bits shards, each with its own spinlock,
+ * hlist bucket array and FIFO queue, and each on its own cache lines, so
+ * threads working on different shards never touch the same lock.
+ *
+ * Unlike LRU (lrucache.h), a hit never relinks anything: it only sets the
+ * node's visited bit, so the critical section of a hit is the bucket walk.
+ * New entries go in at the head of the queue. To make room, the shard's
+ * hand walks from the tail towards the head, clearing visited bits, and
+ * evicts the first unvisited node it meets; the hand stays where it
+ * stopped for the next eviction and wraps around to the tail. Surviving
+ * entries keep their queue position, which is what makes SIEVE scan
+ * resistant.
+ *
+ * Nodes are reference counted, because a node another thread just looked
+ * up may be evicted before it's done with it. The cache holds one
+ * reference from scache_add() until the node is evicted or deleted,
+ * scache_get() takes one for the caller that scache_put() drops, and
+ * whoever drops the last one calls the release callback, outside of any
+ * shard lock.
+ */
+
+#define SCACHE_ALIGN		64
+
+struct scache_node
+{
+	struct hlist_node hnode;
+	TAILQ_ENTRY(scache_node) q;
+	uint64_t key;
+	int refcnt;
+	bool visited;
+};
+
+TAILQ_HEAD(scache_queue, scache_node);
+
+typedef void (*scache_release_fn)(struct scache_node *node, void *arg);
+
+struct scache_shard
+{
+	spinlock_t lock;
+	struct hlist_head *buckets;
+	unsigned int bits;
+	unsigned long count;
+	unsigned long capacity;
+	struct scache_queue queue;	/* newest first */
+	struct scache_node *hand;	/* next eviction candidate, NULL for the tail */
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+} __attribute__((aligned(SCACHE_ALIGN)));
+
+struct scache
+{
+	struct scache_shard *shards;
+	unsigned int shard_bits;
+	scache_release_fn release;
+	void *arg;
+};
+
+/*
+ * The shard comes from a full mix of the key, the bucket from hash_64()
+ * as everywhere else; the two sets of bits are unrelated.
+ */
+static inline struct scache_shard *__scache_shard(const struct scache *c,
+						  uint64_t key)
+{
+	return &c->shards[__hash_mix(key, GOLDEN_RATIO_PRIME_64) &
+			  ((1UL << c->shard_bits) - 1)];
+}
+
+static inline struct hlist_head *__scache_bucket(const struct scache_shard *s,
+						 uint64_t key)
+{
+	return &s->buckets[hash_64(key, s->bits)];
+}
+
+/**
+ * scache_init - initialize a sharded cache
+ * @c: the cache to initialize
+ * @capacity: most entries the cache holds, split evenly over the shards
+ * @shard_bits: log2 of the number of shards
+ * @release: called on each node once the last reference to it is dropped
+ * @arg: passed to @release
+ *
+ * Returns 0 on success and -ENOMEM on allocation failure.
+ */
+static inline int scache_init(struct scache *c, unsigned long capacity,
+			      unsigned int shard_bits,
+			      scache_release_fn release, void *arg)
+{
+	unsigned long i, nshards = 1UL << shard_bits;
+	unsigned long per_shard = (capacity + nshards - 1) / nshards;
+	unsigned int bits = 1;
+	struct scache_shard *s;
+
+	if (!per_shard)
+		per_shard = 1;
+	while ((1UL << bits) < per_shard)
+		bits++;
+
+	c->shards = (struct scache_shard *)aligned_alloc(SCACHE_ALIGN,
+					nshards * sizeof(struct scache_shard));
+	if (!c->shards)
+		return -ENOMEM;
+	c->shard_bits = shard_bits;
+	c->release = release;
+	c->arg = arg;
+
+	for (i = 0; i < nshards; i++) {
+		s = &c->shards[i];
+		spin_lock_init(&s->lock);
+		s->buckets = (struct hlist_head *)calloc(1UL << bits,
+						sizeof(struct hlist_head));
+		s->bits = bits;
+		s->count = 0;
+		s->capacity = per_shard;
+		TAILQ_INIT(&s->queue);
+		s->hand = NULL;
+		s->hits = s->misses = s->evictions = 0;
+		if (!s->buckets) {
+			c->shard_bits = 0;
+			while (i--)
+				free(c->shards[i].buckets);
+			free(c->shards);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static inline void __scache_unref(struct scache *c, struct scache_node *node)
+{
+	if (__atomic_sub_fetch(&node->refcnt, 1, __ATOMIC_ACQ_REL) == 0 &&
+	    c->release)
+		c->release(node, c->arg);
+}
+
+/* unlink @node from its shard, the cache's reference is the caller's now */
+static inline void __scache_unlink(struct scache_shard *s,
+				   struct scache_node *node)
+{
+	if (s->hand == node)
+		s->hand = TAILQ_PREV(node, scache_queue, q);
+	hlist_del_init(&node->hnode);
+	TAILQ_REMOVE(&s->queue, node, q);
+	s->count--;
+}
+
+/* the SIEVE hand: pick and unlink a victim from a non-empty shard */
+static inline struct scache_node *__scache_sieve(struct scache_shard *s)
+{
+	struct scache_node *node = s->hand;
+
+	if (!node)
+		node = TAILQ_LAST(&s->queue, scache_queue);
+	while (node->visited) {
+		node->visited = false;
+		node = TAILQ_PREV(node, scache_queue, q);
+		if (!node)
+			node = TAILQ_LAST(&s->queue, scache_queue);
+	}
+
+	s->hand = TAILQ_PREV(node, scache_queue, q);
+	__scache_unlink(s, node);
+	s->evictions++;
+	return node;
+}
+
+static inline struct scache_node *__scache_find(struct scache_shard *s,
+						uint64_t key)
+{
+	struct scache_node *node;
+
+	hlist_for_each_entry(node, __scache_bucket(s, key), hnode) {
+		if (node->key == key)
+			return node;
+	}
+
+	return NULL;
+}
+
+/**
+ * scache_get - look up a key and take a reference to its node
+ * @c: the cache to search
+ * @key: the key to look up
+ *
+ * Returns the node, to be handed back with scache_put(), or NULL.
+ */
+static inline struct scache_node *scache_get(struct scache *c, uint64_t key)
+{
+	struct scache_shard *s = __scache_shard(c, key);
+	struct scache_node *node;
+
+	spin_lock(&s->lock);
+	node = __scache_find(s, key);
+	if (node) {
+		node->visited = true;
+		__atomic_add_fetch(&node->refcnt, 1, __ATOMIC_RELAXED);
+		s->hits++;
+	} else {
+		s->misses++;
+	}
+	spin_unlock(&s->lock);
+
+	return node;
+}
+
+/**
+ * scache_put - drop a reference taken by scache_get()
+ * @c: the cache the node came from
+ * @node: the node
+ */
+static inline void scache_put(struct scache *c, struct scache_node *node)
+{
+	__scache_unref(c, node);
+}
+
+/**
+ * scache_add - insert a node, evicting one from its shard if it's full
+ * @c: the cache to add to
+ * @node: the node of the object to add
+ * @key: the key of the object
+ *
+ * The cache owns @node from now on and releases it when it's evicted or
+ * deleted and unreferenced. Returns 0 on success or -EEXIST if @key is
+ * already cached, in which case @node is still the caller's.
+ */
+static inline int scache_add(struct scache *c, struct scache_node *node,
+			     uint64_t key)
+{
+	struct scache_shard *s = __scache_shard(c, key);
+	struct scache_node *victim = NULL;
+
+	node->key = key;
+	node->refcnt = 1;
+	node->visited = false;
+
+	spin_lock(&s->lock);
+	if (__scache_find(s, key)) {
+		spin_unlock(&s->lock);
+		return -EEXIST;
+	}
+	if (s->count == s->capacity)
+		victim = __scache_sieve(s);
+	hlist_add_head(&node->hnode, __scache_bucket(s, key));
+	TAILQ_INSERT_HEAD(&s->queue, node, q);
+	s->count++;
+	spin_unlock(&s->lock);
+
+	if (victim)
+		__scache_unref(c, victim);
+	return 0;
+}
+
+/**
+ * scache_del - remove a key from a cache
+ * @c: the cache to remove from
+ * @key: the key to remove
+ *
+ * Returns false if @key wasn't cached.
+ */
+static inline bool scache_del(struct scache *c, uint64_t key)
+{
+	struct scache_shard *s = __scache_shard(c, key);
+	struct scache_node *node;
+
+	spin_lock(&s->lock);
+	node = __scache_find(s, key);
+	if (node)
+		__scache_unlink(s, node);
+	spin_unlock(&s->lock);
+
+	if (node)
+		__scache_unref(c, node);
+	return node != NULL;
+}
+
+/* totals over all shards, each shard read under its lock */
+struct scache_stats
+{
+	unsigned long count;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+};
+
+static inline void scache_stats(struct scache *c, struct scache_stats *st)
+{
+	struct scache_shard *s;
+	unsigned long i;
+
+	st->count = st->hits = st->misses = st->evictions = 0;
+	for (i = 0; i < (1UL << c->shard_bits); i++) {
+		s = &c->shards[i];
+		spin_lock(&s->lock);
+		st->count += s->count;
+		st->hits += s->hits;
+		st->misses += s->misses;
+		st->evictions += s->evictions;
+		spin_unlock(&s->lock);
+	}
+}
+
+/**
+ * scache_destroy - release every node and the shards of a cache
+ * @c: the cache to destroy
+ *
+ * Nodes still referenced by scache_get() callers are released by their
+ * scache_put() instead. No other thread may use @c any more.
+ */
+static inline void scache_destroy(struct scache *c)
+{
+	struct scache_shard *s;
+	struct scache_node *node;
+	unsigned long i;
+
+	for (i = 0; i < (1UL << c->shard_bits); i++) {
+		s = &c->shards[i];
+		while ((node = TAILQ_FIRST(&s->queue))) {
+			__scache_unlink(s, node);
+			__scache_unref(c, node);
+		}
+		free(s->buckets);
+	}
+	free(c->shards);
+	c->shards = NULL;
+}
+
+#endif /* __SHARDCACHE_H__ */
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "shardcache.h"
+#include "lrucache.h"
+
+/* ansi color code */
+#define KNRM  "\x1B[0m"
+#define KRED  "\x1B[31m"
+#define KGRN  "\x1B[32m"
+#define RESET "\033[0m"
+
+#define MAX_THREADS 64
+
+struct item
+{
+    struct scache_node node;
+    struct lru_node lnode;
+    int released;
+};
+
+static unsigned long nallocated, nreleased;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void mark_released(struct scache_node *node, void *arg)
+{
+    (void)arg;
+    container_of(node, struct item, node)->released++;
+}
+
+static void free_item(struct scache_node *node, void *arg)
+{
+    (void)arg;
+    __atomic_add_fetch(&nreleased, 1, __ATOMIC_RELAXED);
+    free(container_of(node, struct item, node));
+}
+
+static void free_litem(struct lru_node *node, void *arg)
+{
+    (void)arg;
+    free(container_of(node, struct item, lnode));
+}
+
+void TEST_SCACHE()
+{
+    static struct item items[100];
+    struct scache_node *node;
+    struct scache_stats st;
+    struct scache c;
+    bool ok = true;
+    int i;
+
+    if (scache_init(&c, 64, 0, mark_released, NULL)) {
+        printf("%-28s" KRED "\tFAILED\n" RESET, "TEST_SCACHE");
+        return;
+    }
+    for (i = 0; i < 64; i++)
+        if (scache_add(&c, &items[i].node, i))
+            ok = false;
+    if (scache_add(&c, &items[99].node, 5) != -EEXIST)
+        ok = false;
+
+    /* visited 0..31 survive the hand's first sweep, 32 and 33 don't */
+    for (i = 0; i < 32; i++) {
+        node = scache_get(&c, i);
+        if (node != &items[i].node)
+            ok = false;
+        else
+            scache_put(&c, node);
+    }
+    scache_add(&c, &items[64].node, 64);
+    scache_add(&c, &items[65].node, 65);
+    for (i = 0; i < 66; i++)
+        if (items[i].released != (i == 32 || i == 33))
+            ok = false;
+
+    /* a held node is unlinked on delete but released on the last put */
+    node = scache_get(&c, 40);
+    if (!scache_del(&c, 40) || scache_del(&c, 40) || items[40].released)
+        ok = false;
+    if (scache_get(&c, 40))
+        ok = false;
+    scache_put(&c, node);
+    if (items[40].released != 1)
+        ok = false;
+
+    scache_stats(&c, &st);
+    if (st.count != 63 || st.hits != 33 || st.misses != 1 || st.evictions != 2)
+        ok = false;
+    scache_destroy(&c);
+    for (i = 0; i < 66; i++)
+        if (items[i].released != 1)
+            ok = false;
+
+    printf("%-28s", "TEST_SCACHE");
+    if (ok) printf(KGRN "\tPASSED\n" RESET);
+    else printf(KRED "\tFAILED\n" RESET);
+}
+
+/* Zipf keys over [0, @range) with exponent 1, weights 1 / (k + 1): no libm */
+static uint64_t *zipf_keys(unsigned long range, long nops)
+{
+    double *cdf = (double *)malloc(sizeof(double) * range);
+    uint64_t *keys = (uint64_t *)malloc(sizeof(uint64_t) * nops);
+    double sum = 0, u;
+    unsigned long lo, hi, mid, k;
+    long i;
+
+    for (k = 0; k < range; k++)
+        cdf[k] = sum += 1.0 / (k + 1);
+    for (i = 0; i < nops; i++) {
+        u = (double)rand() / RAND_MAX * sum;
+        for (lo = 0, hi = range - 1; lo < hi;) {
+            mid = (lo + hi) / 2;
+            if (cdf[mid] < u)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        keys[i] = lo * 0x9e3779b97f4a7c15ULL;
+    }
+
+    free(cdf);
+    return keys;
+}
+
+struct worker
+{
+    pthread_t tid;
+    const uint64_t *keys;
+    long nops;
+};
+
+static struct scache cache;
+static struct lru_cache lru;
+static pthread_mutex_t lru_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* read-through: a miss allocates the object and fills the cache */
+static void *run_scache(void *arg)
+{
+    struct worker *w = (struct worker *)arg;
+    struct scache_node *node;
+    struct item *it;
+    long i;
+
+    for (i = 0; i < w->nops; i++) {
+        node = scache_get(&cache, w->keys[i]);
+        if (node) {
+            scache_put(&cache, node);
+            continue;
+        }
+        it = (struct item *)malloc(sizeof(*it));
+        if (scache_add(&cache, &it->node, w->keys[i]))
+            free(it);
+        else
+            __atomic_add_fetch(&nallocated, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+/* the same workload on one LRU behind one lock */
+static void *run_lru(void *arg)
+{
+    struct worker *w = (struct worker *)arg;
+    struct item *it;
+    long i;
+
+    for (i = 0; i < w->nops; i++) {
+        pthread_mutex_lock(&lru_lock);
+        if (!lru_get(&lru, w->keys[i])) {
+            it = (struct item *)malloc(sizeof(*it));
+            lru_add(&lru, &it->lnode, w->keys[i], 1);
+        }
+        pthread_mutex_unlock(&lru_lock);
+    }
+
+    return NULL;
+}
+
+static double run(void *(*fn)(void *), const uint64_t *keys, long nops,
+                  int nthreads)
+{
+    struct worker w[MAX_THREADS];
+    double t;
+    int i;
+
+    t = now();
+    for (i = 0; i < nthreads; i++) {
+        w[i].keys = keys + nops / nthreads * i;
+        w[i].nops = nops / nthreads;
+        pthread_create(&w[i].tid, NULL, fn, &w[i]);
+    }
+    for (i = 0; i < nthreads; i++)
+        pthread_join(w[i].tid, NULL);
+
+    return now() - t;
+}
+
+/*
+ * Every thread count replays the same @nops Zipfian keys, split between
+ * the threads, against a cache holding 1/10 of @range.
+ */
+void compare_threads(unsigned long range, long nops, int max_threads,
+                     unsigned int shard_bits)
+{
+    uint64_t *keys = zipf_keys(range, nops);
+    unsigned long cap = range / 10;
+    struct scache_stats st;
+    double ts, tl;
+    int n;
+
+    printf("%-9s%-14s%-14s%-14s%-14s\n", "Threads", "SIEVE Mops/s",
+           "SIEVE hits", "LRU Mops/s", "LRU hits");
+    for (n = 1; n <= max_threads; n *= 2) {
+        if (scache_init(&cache, cap, shard_bits, free_item, NULL) ||
+            lru_init(&lru, cap, 0, free_litem, NULL)) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+
+        ts = run(run_scache, keys, nops, n);
+        tl = run(run_lru, keys, nops, n);
+
+        scache_stats(&cache, &st);
+        printf("%-9d%-14.2f%-14.4f%-14.2f%-14.4f\n", n, nops / ts / 1e6,
+               (double)st.hits / (st.hits + st.misses), nops / tl / 1e6,
+               lru_hit_ratio(&lru));
+        scache_destroy(&cache);
+        lru_destroy(&lru);
+        if (nreleased != nallocated)
+            printf(KRED "%lu of %lu nodes released\n" RESET, nreleased,
+                   nallocated);
+    }
+
+    free(keys);
+}
+
+int main(int argc, char **argv)
+{
+    int nthreads;
+
+    if (argc != 5) {
+        fprintf(stderr, "usage: %s <nkeys> <nops> <max threads> <shard bits>\n",
+                argv[0]);
+        exit(1);
+    }
+    nthreads = atoi(argv[3]);
+    if (nthreads < 1 || nthreads > MAX_THREADS) {
+        fprintf(stderr, "threads must be in [1, %d]\n", MAX_THREADS);
+        exit(1);
+    }
+
+    srand((unsigned)time(0));
+    TEST_SCACHE();
+    compare_threads(strtoul(argv[1], NULL, 0), atol(argv[2]), nthreads,
+                    atoi(argv[4]));
+
+    return 0;
+}
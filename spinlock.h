@@ -0,0 +1,59 @@
+#ifndef __SPINLOCK_H__
+#define __SPINLOCK_H__
+
+#include <sched.h>
+
+/*
+ * Minimal test-and-test-and-set spinlock. Waiters spin on a plain load so
+ * the cache line stays shared until the holder releases it, and give the
+ * CPU away after a while so an oversubscribed machine still makes progress.
+ */
+
+typedef struct
+{
+	int locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT		{ .locked = 0 }
+#define DEFINE_SPINLOCK(x)	spinlock_t x = SPINLOCK_INIT
+#define SPIN_YIELD_AFTER	1024
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()	__builtin_ia32_pause()
+#else
+#define cpu_relax()	__asm__ __volatile__("" : : : "memory")
+#endif
+
+static inline void spin_lock_init(spinlock_t *lock)
+{
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELAXED);
+}
+
+static inline int spin_trylock(spinlock_t *lock)
+{
+	return !__atomic_load_n(&lock->locked, __ATOMIC_RELAXED) &&
+	       !__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE);
+}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+	unsigned int spins = 0;
+
+	while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED)) {
+			if (++spins < SPIN_YIELD_AFTER) {
+				cpu_relax();
+			} else {
+				sched_yield();
+				spins = 0;
+			}
+		}
+	}
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+#endif /* __SPINLOCK_H__ */